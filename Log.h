@@ -21,14 +21,202 @@
 #pragma once
 
 #include <iostream>
-#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <unordered_set>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <csignal>
+#include <cerrno>
+#include "RingBuffer.h"
+
+#if defined( __WIN32__ ) || defined( _WIN32 )
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+// use std::to_chars for fast number formatting when available (C++17),
+// otherwise fall back to snprintf
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#define LOG_HAVE_TO_CHARS
+#if defined(__cpp_lib_to_chars)
+#define LOG_HAVE_TO_CHARS_FLOAT
+#endif
+#endif
+#endif
+
+// append std::string_view without a stream when available (C++17)
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<string_view>)
+#include <string_view>
+#define LOG_HAVE_STRING_VIEW
+#endif
+#endif
+
+/// compile-time minimum level using Log::Level values, statements for lower
+/// levels are compiled out without constructing a Log or evaluating arguments
+/// ex. -DLOG_MIN_LEVEL=0 removes LOG_DEBUG & LOG_VERBOSE
+/// default: debug is only available if LOG_STATIC_LEVEL or DEBUG is defined
+#ifndef LOG_MIN_LEVEL
+#if defined(LOG_STATIC_LEVEL) || defined(DEBUG)
+#define LOG_MIN_LEVEL -2
+#else
+#define LOG_MIN_LEVEL -1
+#endif
+#endif
+
+/// discard a statement, arguments are type checked but never evaluated
+#define LOG_DISCARD(level) while(false) Log(level)
+
+/// log at a level, checks the runtime filter up front so filtered statements
+/// skip constructing a Log and evaluating arguments
+#ifdef LOG_STATIC_LEVEL
+#define LOG_LEVEL(level) !Log::wanted(level) ? (void)0 : Log::Voidify() & Log(level)
+#else
+#define LOG_LEVEL(level) Log(level)
+#endif
+
+/// unique id for the calling statement's file & line, registered once
+#define LOG_SITE []() -> unsigned int { \
+	static const unsigned int site = Log::site(__FILE__, __LINE__); \
+	return site; \
+}()
+
+/// log at a level in binary mode: arguments are captured raw along with the
+/// statement's site id and formatted later by the async backend thread,
+/// or written to the binary file for offline decoding, see Log::openBinaryFile()
+/// note: levels below LOG_MIN_LEVEL are compiled out
+#ifdef LOG_STATIC_LEVEL
+#define LOG_BINARY(level) !((level) >= LOG_MIN_LEVEL && Log::wanted(level)) ? (void)0 : \
+	Log::Voidify() & Log(level, LOG_SITE)
+#else
+#define LOG_BINARY(level) !((level) >= LOG_MIN_LEVEL) ? (void)0 : \
+	Log::Voidify() & Log(level, LOG_SITE)
+#endif
+
+/// a string literal which binary mode stores by address instead of copying,
+/// anything but a string literal fails to compile:
+///
+///     LOG_BINARY(Log::LEVEL_WARN) << LOG_LITERAL("took ") << ms << std::endl;
+#define LOG_LITERAL(text) Log::Literal{"" text, sizeof(text) - 1}
 
 // convenience defines
-#define LOG         Log(Log::LEVEL_NORMAL)
-#define LOG_DEBUG   Log(Log::LEVEL_DEBUG)
-#define LOG_VERBOSE Log(Log::LEVEL_VERBOSE)
-#define LOG_WARN    Log(Log::LEVEL_WARN)
-#define LOG_ERROR   Log(Log::LEVEL_ERROR)
+#if LOG_MIN_LEVEL <= 0
+#define LOG         LOG_LEVEL(Log::LEVEL_NORMAL)
+#else
+#define LOG         LOG_DISCARD(Log::LEVEL_NORMAL)
+#endif
+#if LOG_MIN_LEVEL <= -2
+#define LOG_DEBUG   LOG_LEVEL(Log::LEVEL_DEBUG)
+#else
+#define LOG_DEBUG   LOG_DISCARD(Log::LEVEL_DEBUG)
+#endif
+#if LOG_MIN_LEVEL <= -1
+#define LOG_VERBOSE LOG_LEVEL(Log::LEVEL_VERBOSE)
+#else
+#define LOG_VERBOSE LOG_DISCARD(Log::LEVEL_VERBOSE)
+#endif
+#if LOG_MIN_LEVEL <= 1
+#define LOG_WARN    LOG_LEVEL(Log::LEVEL_WARN)
+#else
+#define LOG_WARN    LOG_DISCARD(Log::LEVEL_WARN)
+#endif
+#if LOG_MIN_LEVEL <= 2
+#define LOG_ERROR   LOG_LEVEL(Log::LEVEL_ERROR)
+#else
+#define LOG_ERROR   LOG_DISCARD(Log::LEVEL_ERROR)
+#endif
+
+/// tag id for a named log category, registered once per statement
+#define LOG_TAG_ID(name) Log::Tag{[]() -> int { \
+	static const int index = Log::tag(name); \
+	return index; \
+}()}
+
+/// log at a level with a named category which can have it's own runtime level,
+/// see Log::setTagLevel(), the level check is always up front
+#define LOG_TAG_LEVEL(name, level) !Log::wanted(level, LOG_TAG_ID(name)) ? (void)0 : \
+	Log::Voidify() & Log(level, LOG_TAG_ID(name))
+
+// tagged convenience defines
+#if LOG_MIN_LEVEL <= 0
+#define LOG_TAG(name)         LOG_TAG_LEVEL(name, Log::LEVEL_NORMAL)
+#else
+#define LOG_TAG(name)         LOG_DISCARD(Log::LEVEL_NORMAL)
+#endif
+#if LOG_MIN_LEVEL <= -2
+#define LOG_TAG_DEBUG(name)   LOG_TAG_LEVEL(name, Log::LEVEL_DEBUG)
+#else
+#define LOG_TAG_DEBUG(name)   LOG_DISCARD(Log::LEVEL_DEBUG)
+#endif
+#if LOG_MIN_LEVEL <= -1
+#define LOG_TAG_VERBOSE(name) LOG_TAG_LEVEL(name, Log::LEVEL_VERBOSE)
+#else
+#define LOG_TAG_VERBOSE(name) LOG_DISCARD(Log::LEVEL_VERBOSE)
+#endif
+#if LOG_MIN_LEVEL <= 1
+#define LOG_TAG_WARN(name)    LOG_TAG_LEVEL(name, Log::LEVEL_WARN)
+#else
+#define LOG_TAG_WARN(name)    LOG_DISCARD(Log::LEVEL_WARN)
+#endif
+#if LOG_MIN_LEVEL <= 2
+#define LOG_TAG_ERROR(name)   LOG_TAG_LEVEL(name, Log::LEVEL_ERROR)
+#else
+#define LOG_TAG_ERROR(name)   LOG_DISCARD(Log::LEVEL_ERROR)
+#endif
+
+/// per-statement rate limit state, see Log::Limit
+#define LOG_LIMIT_STATE []() -> Log::Limit& { \
+	static Log::Limit limit; \
+	return limit; \
+}()
+
+/// log at a level when check passes, check returns the number of suppressed
+/// calls + 1 or 0 to suppress, suppressed calls don't construct a Log or
+/// evaluate arguments and the count is prefixed to the next line let through
+#define LOG_LIMIT(level, check) \
+	for(std::uint64_t log_pass_ = ((level) >= LOG_MIN_LEVEL && Log::wanted(level) ? \
+	    (check) : 0); log_pass_; log_pass_ = 0) Log(level, Log::Suppressed{log_pass_ - 1})
+
+/// log every n calls of this statement, starting with the first
+#define LOG_EVERY_N(level, n) LOG_LIMIT(level, LOG_LIMIT_STATE.every(n))
+
+/// log the first n calls of this statement only
+#define LOG_FIRST_N(level, n) LOG_LIMIT(level, LOG_LIMIT_STATE.first(n))
+
+/// log at most once every ms milliseconds for this statement
+/// note: uses the coarse monotonic clock, so the resolution is a few ms
+#define LOG_EVERY_MS(level, ms) LOG_LIMIT(level, LOG_LIMIT_STATE.everyMs(ms))
+
+/// log a random fraction of calls of this statement, probability is 0 - 1
+#define LOG_SAMPLED(level, probability) LOG_LIMIT(level, LOG_LIMIT_STATE.sampled(probability))
+
+/// log from a signal handler, see Log::Safe
+#define LOG_SAFE(level) Log::Safe(level)
+
+/// number of counters used to track threads writing to the current sink,
+/// threads share them round robin, see Log::setSink()
+#ifndef LOG_SINK_READERS
+#define LOG_SINK_READERS 64
+#endif
+
+/// max number of log tags, including the untagged index 0
+#ifndef LOG_MAX_TAGS
+#define LOG_MAX_TAGS 64
+#endif
 
 // flush after printing on windows to avoid console output buffering issues
 #if defined( __WIN32__ ) || defined( _WIN32 )
@@ -41,12 +229,68 @@
 
 /// filter using static Log::logLevel
 /// note: storage and a default value needs to be set in a .cpp file
-///       ex. Log::Level Log::logLevel = Log::LEVEL_NORMAL;
+///       ex. std::atomic<Log::Level> Log::logLevel(Log::LEVEL_NORMAL);
 #ifdef LOG_STATIC_LEVEL
-#define LOG_FILTER if(m_level < Log::logLevel) {return;}
+#define LOG_FILTER if(!Log::enabled(m_level, m_tag)) {return;}
+#elif defined(DEBUG)
+#define LOG_FILTER if(m_tag.index && !Log::enabled(m_level, m_tag)) {return;}
 #else
 // otherwise always print, except debug is only available if DEBUG is defined
-#define LOG_FILTER
+#define LOG_FILTER if(m_level == Log::LEVEL_DEBUG || \
+                      (m_tag.index && !Log::enabled(m_level, m_tag))) {return;}
+#endif
+
+/// inline Log line buffer size in bytes, longer lines overflow into a
+/// reusable thread-local buffer
+#ifndef LOG_LINE_SIZE
+#define LOG_LINE_SIZE 256
+#endif
+
+/// default per-thread async ring buffer capacity in records,
+/// see Log::startAsync()
+#ifndef LOG_ASYNC_CAPACITY
+#define LOG_ASYNC_CAPACITY 8192
+#endif
+
+/// async merge window in microseconds: the backend holds lines back for this
+/// long so lines from other threads with earlier timestamps can catch up
+#ifndef LOG_ASYNC_MERGE_WINDOW
+#define LOG_ASYNC_MERGE_WINDOW 1000
+#endif
+
+/// async backend thread sleep time in ms when there is nothing to print
+#ifndef LOG_ASYNC_SLEEP
+#define LOG_ASYNC_SLEEP 1
+#endif
+
+/// default flight recorder size in lines per thread, see Log::startRecorder()
+#ifndef LOG_RECORDER_LINES
+#define LOG_RECORDER_LINES 512
+#endif
+
+/// flight recorder line size in bytes, longer lines are truncated
+#ifndef LOG_RECORDER_LINE_SIZE
+#define LOG_RECORDER_LINE_SIZE 256
+#endif
+
+/// async-signal-safe line buffer size in bytes, see Log::Safe
+#ifndef LOG_SAFE_SIZE
+#define LOG_SAFE_SIZE 512
+#endif
+
+/// max number of threads with flight recorder buffers at once
+#ifndef LOG_RECORDER_THREADS
+#define LOG_RECORDER_THREADS 256
+#endif
+
+/// number of dedup hash table slots, a power of 2, see Log::setDedup()
+#ifndef LOG_DEDUP_SLOTS
+#define LOG_DEDUP_SLOTS 256
+#endif
+
+/// dedup line copy size in bytes for "repeated" lines
+#ifndef LOG_DEDUP_TEXT_SIZE
+#define LOG_DEDUP_TEXT_SIZE 128
 #endif
 
 /// \class Log
@@ -57,6 +301,75 @@
 /// how to catch std::endl (which is actually a func pointer):
 /// http://yvan.seth.id.au/Entries/Technology/Code/std__endl.html
 ///
+/// lines are built in a fixed-size inline buffer which overflows into a
+/// reusable thread-local buffer, so there are no heap allocations per line
+/// after warm up, integers and floats are formatted directly into the buffer
+/// and other types are written via a reusable thread-local std::ostream
+///
+/// by default, lines are printed synchronously when each Log object goes out
+/// of scope, optionally start async mode to push finished lines into a
+/// per-thread lock-free ring buffer, which are merged in timestamp order and
+/// printed by a background thread:
+///
+///     int main() {
+///         Log::startAsync();
+///         ...
+///         LOG << "hello world" << std::endl; // returns without printing
+///         ...
+///         Log::stopAsync(); // prints any waiting lines
+///         return 0;
+///     }
+///
+/// for the highest rate statements, binary mode captures raw arguments and
+/// defers formatting to the backend thread or offline decoding:
+///
+///     Log::openBinaryFile("app.logb"); // otherwise decoded to text
+///     Log::startAsync();
+///     ...
+///     LOG_BINARY(Log::LEVEL_WARN) << LOG_LITERAL("took ") << ms << std::endl;
+///
+/// strings are copied, wrap string literals in LOG_LITERAL so only their
+/// address is stored, and decode to text with tools/logdecode or
+/// Log::decodeBinaryFile()
+///
+/// named categories can be filtered separately, the tag's level table slot
+/// is looked up once per statement so the check is a single atomic load:
+///
+///     Log::setTagLevel("net", Log::LEVEL_WARN);
+///     ...
+///     LOG_TAG_VERBOSE("net") << "connected" << std::endl; // filtered
+///
+/// statements in hot loops can be rate limited per call site, suppressed
+/// calls skip constructing a Log and the count is reported on the next line:
+///
+///     LOG_EVERY_MS(Log::LEVEL_WARN, 1000) << "queue full" << std::endl;
+///
+/// typed key/value fields can be added to a line, which are written inline
+/// as key=value or as fields of a JSON object per line in JSON format:
+///
+///     Log::setFormat(Log::FORMAT_JSON);
+///     ...
+///     LOG << "request done" << Log::kv("latency_us", us) << std::endl;
+///     // {"level":"normal","msg":"request done","latency_us":42}
+///
+/// the flight recorder keeps the last lines of every level per thread in
+/// memory and only prints warnings & errors, the history is dumped to stderr
+/// by calling Log::dumpRecorder() or on a fatal signal if the crash handler
+/// is installed:
+///
+///     Log::startRecorder(LOG_RECORDER_LINES, Log::LEVEL_WARN, true);
+///     ...
+///     LOG_VERBOSE << "state " << state << std::endl; // recorded only
+///
+/// call Log::installCrashHandler() to write async mode lines that haven't
+/// been printed yet when the process dies from a fatal signal, and use
+/// LOG_SAFE in your own signal handlers instead of LOG
+///
+/// lines are printed to std::cout & std::cerr by default, set a Log::Sink
+/// to write them elsewhere, see LogSinks.h:
+///
+///     Log::setSink(std::make_shared<LogFileSink>("app.log"));
+///
 class Log {
 
 	public:
@@ -70,63 +383,2442 @@ class Log {
 			LEVEL_ERROR   =  2  ///< errors
 		};
 
+		/// async mode policies when a thread's ring buffer is full, see
+		/// Log::setOverflow()
+		enum Overflow {
+			OVERFLOW_BLOCK,       ///< wait for the backend thread
+			OVERFLOW_DROP_NEWEST, ///< drop the new line
+			OVERFLOW_DROP_OLDEST  ///< drop the oldest waiting line to make room,
+			                      ///< blocking level lines are kept instead
+		};
+
+		/// output formats
+		enum Format {
+			FORMAT_TEXT, ///< human readable text
+			FORMAT_JSON  ///< JSON Lines, one object per line with fields, see kv()
+		};
+
 		#ifdef LOG_STATIC_LEVEL
-		static Level logLevel; ///< levels below this will be filtered
+		/// levels below this will be filtered,
+		/// atomic so it can be changed at runtime from any thread
+		static std::atomic<Level> logLevel;
 		#endif
 
+		/// returns true if a level passes the runtime filter
+		static bool enabled(Level level) {
+			#ifdef LOG_STATIC_LEVEL
+			return level >= logLevel.load(std::memory_order_relaxed);
+			#else
+			(void)level;
+			return true;
+			#endif
+		}
+
+		/// a log category index, 0 is untagged
+		struct Tag {
+			int index;
+		};
+
+		/// returns true if a level passes the runtime filter for a tag,
+		/// tags follow the global filter unless they have their own level
+		static bool enabled(Level level, Tag tag) {
+			int tagLevel = tags().levels[tag.index].load(std::memory_order_relaxed);
+			if(tagLevel == TAG_INHERIT) {return enabled(level);}
+			return level >= tagLevel;
+		}
+
+		/// returns true if a statement at a level should be built: it passes
+		/// the runtime filter or the flight recorder is running to record it,
+		/// used by the LOG macros, the filter is checked again before printing
+		static bool wanted(Level level) {
+			return enabled(level) || recording();
+		}
+
+		/// returns true if a tagged statement at a level should be built
+		static bool wanted(Level level, Tag tag) {
+			return enabled(level, tag) || recording();
+		}
+
+		/// number of calls suppressed before a rate limited line
+		struct Suppressed {
+			std::uint64_t count;
+		};
+
+		/// per-statement rate limit state for LOG_EVERY_N, LOG_FIRST_N,
+		/// LOG_EVERY_MS & LOG_SAMPLED, checks return 0 to suppress or the
+		/// number of calls suppressed since the last pass + 1
+		///
+		/// a suppressed call costs one relaxed atomic increment, the counts
+		/// are approximate when multiple threads pass at the same time
+		struct Limit {
+			std::atomic<std::uint64_t> count;  ///< number of calls
+			std::atomic<std::uint64_t> passed; ///< count after the last pass
+			std::atomic<std::uint64_t> time;   ///< last pass time in ms + 1
+			Limit() : count(0), passed(0), time(0) {}
+
+			/// pass every n calls
+			std::uint64_t every(std::uint64_t n) {
+				std::uint64_t c = count.fetch_add(1, std::memory_order_relaxed);
+				if(n > 1 && c % n != 0) {return 0;}
+				return pass(c);
+			}
+
+			/// pass the first n calls
+			std::uint64_t first(std::uint64_t n) {
+				if(count.load(std::memory_order_relaxed) >= n) {return 0;}
+				std::uint64_t c = count.fetch_add(1, std::memory_order_relaxed);
+				if(c >= n) {return 0;}
+				return pass(c);
+			}
+
+			/// pass at most once every ms milliseconds
+			std::uint64_t everyMs(std::uint64_t ms) {
+				std::uint64_t c = count.fetch_add(1, std::memory_order_relaxed);
+				std::uint64_t now = coarse() / 1000000 + 1;
+				std::uint64_t last = time.load(std::memory_order_relaxed);
+				if(last && now - last < ms) {return 0;}
+				if(!time.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+					return 0; // another thread passed
+				}
+				return pass(c);
+			}
+
+			/// pass with a probability of 0 - 1
+			std::uint64_t sampled(double probability) {
+				std::uint64_t c = count.fetch_add(1, std::memory_order_relaxed);
+				if(random() >= probability * 4294967296.0) {return 0;}
+				return pass(c);
+			}
+
+			/// mark call c as passed
+			std::uint64_t pass(std::uint64_t c) {
+				std::uint64_t previous = passed.exchange(c + 1, std::memory_order_relaxed);
+				return (c >= previous ? c - previous : 0) + 1;
+			}
+
+			/// thread-local xorshift random number, 0 - 2^32-1
+			static std::uint32_t random() {
+				static thread_local std::uint32_t state = 0;
+				if(state == 0) {
+					state = (std::uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) |
+					        1; // never 0
+				}
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return state;
+			}
+		};
+
+		/// swallows a << chain so LOG_LEVEL can be used in a ternary
+		struct Voidify {
+			void operator&(const Log&) {}
+		};
+
+		/// a finished line passed to a Sink
+		struct Message {
+			Level level;        ///< log level
+			const char *text;   ///< line text, not null terminated
+			std::size_t size;   ///< text length
+			std::uint64_t time; ///< wall clock ns since epoch, 0 if timestamps are off
+			const char *tag;    ///< tag name or nullptr if untagged
+			const char *fields; ///< JSON format fields ie. ,"key":value
+			std::size_t fieldsSize; ///< fields length, 0 if none
+		};
+
+		/// a key/value field, see kv()
+		template <class T> struct Field {
+			const char *key;
+			const T &value;
+		};
+
+		/// is T a character type, written as a string in JSON format fields?
+		/// signed & unsigned char are written as numbers, see fieldValue()
+		template <class T> struct IsCharacter {
+			static const bool value = std::is_same<T, char>::value ||
+			                          std::is_same<T, wchar_t>::value ||
+			                          std::is_same<T, char16_t>::value ||
+			                          #ifdef __cpp_char8_t
+			                          std::is_same<T, char8_t>::value ||
+			                          #endif
+			                          std::is_same<T, char32_t>::value;
+		};
+
+		/// returns a field value as written, signed & unsigned char, ie.
+		/// std::int8_t & std::uint8_t, are written as numbers, not characters
+		template <class T> static const T& fieldValue(const T &value) {return value;}
+		static int fieldValue(signed char value) {return value;}
+		static int fieldValue(unsigned char value) {return value;}
+
+		/// an integer written as 0x hex, see hex()
+		struct Hex {
+			std::uint64_t value;
+			int width; ///< min number of digits, zero padded
+		};
+
+		/// a float written with a fixed number of decimals, see fixed()
+		struct Fixed {
+			double value;
+			int precision; ///< number of decimals, 0 - 30
+		};
+
+		/// a byte count written in binary units, see bytes()
+		struct Bytes {
+			std::uint64_t value;
+		};
+
+		/// a string literal, see LOG_LITERAL
+		struct Literal {
+			const char *text;
+			std::size_t size;
+		};
+
+		/// create a key/value field for a Log line, see Log::Field
+		template <class T> static Field<T> kv(const char *key, const T &value) {
+			return Field<T>{key, value};
+		}
+
+		/// format an integer as 0x hex with at least width digits, negative
+		/// values are written as two's complement ie. hex(-1) is 0xffffffff
+		/// for an int:
+		///
+		///     LOG << "flags " << Log::hex(flags, 8); // flags 0x0000002a
+		template <class T> static Hex hex(T value, int width=0) {
+			static_assert(std::is_integral<T>::value, "hex() requires an integer");
+			return Hex{(std::uint64_t)(typename std::make_unsigned<T>::type)value, width};
+		}
+
+		/// format a float with a fixed number of decimals, written as a number
+		/// in JSON format fields:
+		///
+		///     LOG << "took " << Log::fixed(ms, 3) << " ms"; // took 12.500 ms
+		static Fixed fixed(double value, int precision) {
+			return Fixed{value, precision};
+		}
+
+		/// format a byte count in binary units with one decimal and no space
+		/// so it stays a single token, ie. 512B, 1.5KiB, 12.0MiB
+		static Bytes bytes(std::uint64_t value) {
+			return Bytes{value};
+		}
+
+		/// \class Sink
+		/// \brief log output destination base class
+		///
+		/// write() is called from the logging thread in sync mode or the backend
+		/// thread in async mode, so implementations should be thread safe
+		class Sink {
+			public:
+				virtual ~Sink() {}
+
+				/// write a finished message, see Log::format()
+				virtual void write(const Message &message) = 0;
+
+				/// write out anything buffered, called by Log::flush()
+				virtual void flush() {}
+
+				/// called by the async backend thread when it runs out of
+				/// lines, flushes by default, override to keep small buffers
+				/// around longer while idle
+				virtual void idle() {flush();}
+
+				/// write out anything buffered from a fatal signal handler, see
+				/// Log::installCrashHandler(), only use async-signal-safe calls
+				/// ie. write(2) and no locks, allocation, or stdio
+				virtual void crashed() {}
+
+				/// file descriptor lines at a level can be written to directly
+				/// from a fatal signal handler after crashed(), or -1 if not
+				/// supported, in which case they go to stderr, see
+				/// Log::flushSafe()
+				virtual int safeFd(Level level) {
+					(void)level;
+					return -1;
+				}
+		};
+
+		/// \class Safe
+		/// \brief minimal async-signal-safe logger for signal handlers
+		///
+		/// formats into a fixed-size buffer without allocation or locks and
+		/// writes the line with a single write(2) when it goes out of scope,
+		/// only strings, chars, integers, and pointers are supported:
+		///
+		///     void handler(int signal) {
+		///         LOG_SAFE(Log::LEVEL_ERROR) << "caught signal " << signal;
+		///     }
+		///
+		/// lines longer than LOG_SAFE_SIZE are truncated
+		class Safe {
+
+			public:
+
+				/// write to fd, stderr by default
+				Safe(Level level, int fd=2) : m_fd(fd) {
+					*this << prefix(level);
+				}
+
+				/// write the line, adding a newline if needed
+				~Safe() {
+					if(m_size == 0 || m_text[m_size - 1] != '\n') {
+						m_text[m_size++] = '\n'; // space is reserved
+					}
+					writeFd(m_fd, m_text, m_size);
+				}
+
+				Safe& operator<<(const char *s) {
+					if(!s) {return *this;}
+					while(*s && m_size < LOG_SAFE_SIZE - 1) {
+						m_text[m_size++] = *s++;
+					}
+					return *this;
+				}
+
+				Safe& operator<<(char c) {
+					if(m_size < LOG_SAFE_SIZE - 1) {m_text[m_size++] = c;}
+					return *this;
+				}
+
+				/// bools as true or false
+				Safe& operator<<(bool value) {
+					return *this << (value ? "true" : "false");
+				}
+
+				/// integers as decimal
+				template <class T> typename std::enable_if<std::is_integral<T>::value, Safe&>::type
+				operator<<(T value) {
+					std::uint64_t magnitude = (std::uint64_t)value;
+					if(std::is_signed<T>::value && value < (T)0) {
+						*this << '-';
+						magnitude = 0 - magnitude;
+					}
+					char text[20];
+					std::size_t size = append(text, 0, magnitude);
+					for(std::size_t i = 0; i < size; ++i) {*this << text[i];}
+					return *this;
+				}
+
+				/// pointers as hex
+				Safe& operator<<(const void *pointer) {
+					static const char hex[] = "0123456789abcdef";
+					std::uintptr_t value = (std::uintptr_t)pointer;
+					*this << "0x";
+					for(int shift = (int)sizeof(value) * 8 - 4; shift >= 0; shift -= 4) {
+						*this << hex[(value >> shift) & 0xF];
+					}
+					return *this;
+				}
+
+			private:
+
+				Safe(Safe const&);              // not defined, not copyable
+				Safe& operator = (Safe const&); // not defined, not assignable
+
+				int m_fd;                      ///< file descriptor
+				char m_text[LOG_SAFE_SIZE];    ///< line buffer
+				std::size_t m_size = 0;        ///< line length
+		};
+
+		/// \class Line
+		/// \brief line buffer with inline storage which overflows into a
+		///        pooled thread-local buffer, no heap allocation after warm up
+		class Line {
+
+			public:
+
+				Line() {}
+				~Line() {
+					if(m_overflow) {
+						pool().push_back(m_overflow);
+					}
+				}
+
+				/// append size bytes
+				void append(const char *s, std::size_t size) {
+					std::memcpy(reserve(size), s, size);
+					m_size += size;
+				}
+
+				/// append a single char
+				void append(char c) {
+					*reserve(1) = c;
+					m_size++;
+				}
+
+				/// returns a pointer to write at least size bytes at the end
+				/// of the line, call commit() with the number actually written
+				char* reserve(std::size_t size) {
+					if(m_size + size > m_capacity) {
+						grow(m_size + size);
+					}
+					return m_data + m_size;
+				}
+
+				/// commit size bytes written after a call to reserve()
+				void commit(std::size_t size) {m_size += size;}
+
+				/// clear contents, keeps capacity
+				void clear() {m_size = 0;}
+
+				/// shorten to size bytes, keeps capacity
+				void truncate(std::size_t size) {
+					if(size < m_size) {m_size = size;}
+				}
+
+				char* data() {return m_data;}
+				const char* data() const {return m_data;}
+				std::size_t size() const {return m_size;}
+				bool empty() const {return m_size == 0;}
+
+			private:
+
+				Line(Line const&);              // not defined, not copyable
+				Line& operator = (Line const&); // not defined, not assignable
+
+				/// move to a larger overflow buffer, overflow buffers are
+				/// resized but never shrunk so they are only zero filled once
+				void grow(std::size_t size) {
+					if(!m_overflow) {
+						std::vector<std::string*> &free = pool();
+						if(free.empty()) {
+							m_overflow = new std::string;
+						}
+						else {
+							m_overflow = free.back();
+							free.pop_back();
+						}
+						if(m_overflow->size() < size) {
+							m_overflow->resize(size < 2 * LOG_LINE_SIZE ? 2 * LOG_LINE_SIZE : size);
+						}
+						std::memcpy(&(*m_overflow)[0], m_inline, m_size);
+					}
+					else if(m_overflow->size() < size) {
+						m_overflow->resize(size < 2 * m_overflow->size() ? 2 * m_overflow->size() : size);
+					}
+					m_data = &(*m_overflow)[0];
+					m_capacity = m_overflow->size();
+				}
+
+				/// thread-local pool of free overflow buffers, multiple
+				/// buffers are needed when Logs are nested
+				static std::vector<std::string*>& pool() {
+					struct Pool {
+						std::vector<std::string*> free;
+						~Pool() {
+							for(std::size_t i = 0; i < free.size(); ++i) {
+								delete free[i];
+							}
+						}
+					};
+					static thread_local Pool pool;
+					return pool.free;
+				}
+
+				char m_inline[LOG_LINE_SIZE];      ///< inline storage
+				char *m_data = m_inline;           ///< current storage
+				std::size_t m_size = 0;            ///< current length
+				std::size_t m_capacity = LOG_LINE_SIZE; ///< current capacity
+				std::string *m_overflow = nullptr; ///< pooled overflow storage
+		};
+
 		/// select log level, default: normal
 		Log(Level level=LEVEL_NORMAL) : m_level(level) {}
 
-		/// does the actual printing on exit
-		~Log() {
-			LOG_FILTER
-			switch(m_level) {
-				case LEVEL_DEBUG:
-					#if defined(LOG_STATIC_LEVEL) || defined(DEBUG)
-					std::cout << "Debug: " << m_line.str();
-					LOG_FLUSH_COUT
-					#endif
-					break;
-
-				case LEVEL_VERBOSE:
-					std::cout << m_line.str();
-					LOG_FLUSH_COUT
-					break;
+		/// select log level and binary mode site id, see LOG_BINARY
+		Log(Level level, unsigned int site) : m_level(level), m_site(site) {}
 
-				case LEVEL_NORMAL:
-					std::cout << m_line.str();
-					LOG_FLUSH_COUT
-					break;
+		/// select log level and tag, see LOG_TAG
+		Log(Level level, Tag tag) : m_level(level), m_tag(tag) {}
 
-				case LEVEL_WARN:
-					std::cerr << "Warn: " << m_line.str();
-					LOG_FLUSH_CERR
-					break;
+		/// select log level and report suppressed calls, see LOG_LIMIT
+		Log(Level level, Suppressed suppressed) : m_level(level) {
+			if(suppressed.count) {
+				*this << "(" << suppressed.count << " suppressed) ";
+			}
+		}
 
-				case LEVEL_ERROR:
-					std::cerr << "Error: " << m_line.str();
-					LOG_FLUSH_CERR
-					break;
+		/// does the actual printing on exit,
+		/// or pushes the line to the backend thread in async mode
+		~Log() {
+			if(recording() && !record()) {return;}
+			LOG_FILTER
+			if(m_dedup && dedup().window.load(std::memory_order_relaxed) && duplicate()) {return;}
+			std::size_t fields = m_fields.size();
+			if(fields) {m_line.append(m_fields.data(), fields);} // sent as one line
+			Async &async = Log::async();
+			if(async.running) {
+				Queue &queue = producer(async);
+				queue.pushing = true; // seen by stopAsync() or we see it stopping
+				if(async.running) {
+					std::uint64_t time = now();
+					while(!queue.buffer.push([this, time, fields](Record &record) {
+						record.level = m_level;
+						record.site = m_site;
+						record.tag = m_tag.index;
+						record.time = time;
+						record.fields = fields;
+						record.line.assign(m_line.data(), m_line.size());
+					})) {
+						if(!overflow(async, queue)) {break;}
+					}
+					queue.pushing.store(false, std::memory_order_release);
+					return;
+				}
+				queue.pushing = false;
+				std::lock_guard<std::mutex> lock(async.stopMutex); // print after waiting lines
 			}
+			dispatch(m_level, m_site, m_tag.index, m_line.data(), m_line.size(), fields,
+			         timestamp());
 		}
 
 		/// catch << with a template class to read any type of data
 		template <class T> Log& operator<<(const T &value) {
-			m_line << value;
+			return write(value);
+		}
+
+		/// append a key/value field, written inline as key=value in text format
+		/// after a space if needed or collected as a typed field of the JSON
+		/// object in JSON format
+		template <class T> Log& operator<<(const Field<T> &field) {
+			if(m_site || output().format.load(std::memory_order_relaxed) != FORMAT_JSON) {
+				separate();
+				return *this << field.key << '=' << fieldValue(field.value);
+			}
+			m_fields.append(",\"", 2);
+			escape(field.key, std::strlen(field.key), m_fields);
+			m_fields.append("\":", 2);
+
+			// write the value as usual, then move it to the fields
+			std::size_t start = m_line.size();
+			*this << fieldValue(field.value);
+			const char *value = m_line.data() + start;
+			std::size_t size = m_line.size() - start;
+			bool number = ((std::is_arithmetic<T>::value && !IsCharacter<T>::value) ||
+			               std::is_same<T, Fixed>::value) && m_plain;
+			if(number && size > 0 && (value[size - 1] == 'n' || value[size - 1] == 'f')) {
+				m_fields.append("null", 4); // nan & inf aren't valid JSON numbers
+			}
+			else if(number) {
+				m_fields.append(value, size);
+			}
+			else {
+				m_fields.append('"');
+				escape(value, size, m_fields);
+				m_fields.append('"');
+			}
+			m_line.truncate(start);
+			return *this;
+		}
+		Log& operator<<(const Field<bool> &field) {
+			if(m_site || output().format.load(std::memory_order_relaxed) != FORMAT_JSON) {
+				separate();
+				return *this << field.key << '=' << field.value;
+			}
+			m_fields.append(",\"", 2);
+			escape(field.key, std::strlen(field.key), m_fields);
+			if(field.value) {m_fields.append("\":true", 6);}
+			else {m_fields.append("\":false", 7);}
 			return *this;
 		}
 
 		/// catch << ostream function pointers such as std::endl and std::hex
 		Log& operator<<(std::ostream &(*func)(std::ostream&)) {
-			func(m_line);
+			if(func == static_cast<std::ostream &(*)(std::ostream&)>(std::endl)) {
+				return *this << '\n';
+			}
+			return stream(func);
+		}
+		Log& operator<<(std::ios_base &(*func)(std::ios_base&)) {
+			return stream(func);
+		}
+
+		/// append strings without going through a stream
+		Log& operator<<(const std::string &value) {
+			if(m_site) {return encode(value.data(), value.size());}
+			m_line.append(value.data(), value.size());
+			return *this;
+		}
+		#ifdef LOG_HAVE_STRING_VIEW
+		Log& operator<<(std::string_view value) {
+			if(m_site) {return encode(value.data(), value.size());}
+			m_line.append(value.data(), value.size());
 			return *this;
 		}
+		#endif
 
-	private:
+		/// append a string literal with a single copy using it's compile time
+		/// length, const char arrays which aren't filled up to the final '\0'
+		/// are searched for the end instead, arrays are always copied in
+		/// binary mode as a local array can't be told apart from a literal
+		///
+		/// note: text after an embedded '\0' in a literal is kept
+		template <std::size_t N> Log& operator<<(const char (&value)[N]) {
+			std::size_t size = N - 1;
+			if(N < 2 || value[N - 2] == '\0' || value[N - 1] != '\0') {
+				const char *end = (const char *)std::memchr(value, '\0', N);
+				size = (end ? (std::size_t)(end - value) : N);
+			}
+			if(m_site) {return encode(value, size);}
+			m_line.append(value, size);
+			return *this;
+		}
 
-		Log(Log const&);              // not defined, not copyable
-		Log& operator = (Log const&); // not defined, not assignable
+		/// append a string literal, only it's address is stored in binary mode
+		Log& operator<<(const Literal &literal) {
+			if(m_site) {return encode(ARG_LITERAL, (std::uint64_t)(std::uintptr_t)literal.text);}
+			m_line.append(literal.text, literal.size);
+			return *this;
+		}
+		template <std::size_t N> Log& operator<<(char (&value)[N]) {
+			return write((const char *)value);
+		}
+		Log& operator<<(char value) {
+			if(m_site) {return encode(ARG_CHAR, value);}
+			m_line.append(value);
+			return *this;
+		}
 
-		Level m_level;                ///< log level
-		std::ostringstream m_line;    ///< temp buffer
+		/// format numbers directly into the line, unless the stream format
+		/// has been changed by a manipulator such as std::hex or std::setw
+		Log& operator<<(bool value) {
+			if(!m_plain) {return stream(value);}
+			if(m_site) {return encode(ARG_BOOL, (char)value);}
+			m_line.append(value ? '1' : '0');
+			return *this;
+		}
+		Log& operator<<(short value) {return integer(value);}
+		Log& operator<<(unsigned short value) {return integer(value);}
+		Log& operator<<(int value) {return integer(value);}
+		Log& operator<<(unsigned int value) {return integer(value);}
+		Log& operator<<(long value) {return integer(value);}
+		Log& operator<<(unsigned long value) {return integer(value);}
+		Log& operator<<(long long value) {return integer(value);}
+		Log& operator<<(unsigned long long value) {return integer(value);}
+		Log& operator<<(float value) {return floating(value);}
+		Log& operator<<(double value) {return floating(value);}
+
+		/// format helpers, written straight into the line regardless of the
+		/// stream format, see hex(), fixed() & bytes()
+		Log& operator<<(const Hex &hex) {
+			static const char digits[] = "0123456789abcdef";
+			char *p = reserveText(18);
+			int count = 1;
+			while(count < 16 && (hex.value >> (count * 4))) {count++;}
+			if(count < hex.width) {count = (hex.width < 16 ? hex.width : 16);}
+			p[0] = '0';
+			p[1] = 'x';
+			for(int i = 0; i < count; ++i) {
+				p[1 + count - i] = digits[(hex.value >> (i * 4)) & 0xF];
+			}
+			return commitText(2 + count);
+		}
+		Log& operator<<(const Fixed &fixed) {
+			int precision = (fixed.precision < 0 ? 0 : (fixed.precision > 30 ? 30 : fixed.precision));
+			std::size_t size = 320 + precision; // DBL_MAX has 309 integer digits
+			char *p = reserveText(size);
+			#ifdef LOG_HAVE_TO_CHARS_FLOAT
+				return commitText(std::to_chars(p, p + size, fixed.value,
+				                                std::chars_format::fixed, precision).ptr - p);
+			#else
+				return commitText(std::snprintf(p, size, "%.*f", precision, fixed.value));
+			#endif
+		}
+		Log& operator<<(const Bytes &bytes) {
+			static const char units[] = "KMGTPE";
+			char *p = reserveText(24);
+			std::size_t size = 0;
+			if(bytes.value < 1024) {
+				size = append(p, 0, bytes.value);
+				p[size++] = 'B';
+				return commitText(size);
+			}
+			int unit = 0;
+			double scaled = (double)bytes.value / 1024.0;
+			while(scaled >= 1023.95 && unit < 5) { // don't round up to 1024.0
+				scaled /= 1024.0;
+				unit++;
+			}
+			std::uint64_t tenths = (std::uint64_t)(scaled * 10.0 + 0.5);
+			size = append(p, 0, tenths / 10);
+			p[size++] = '.';
+			p[size++] = (char)('0' + tenths % 10);
+			p[size++] = units[unit];
+			p[size++] = 'i';
+			p[size++] = 'B';
+			return commitText(size);
+		}
+
+	/// \section Async
+
+		/// start async mode: each thread pushes lines into it's own lock-free
+		/// ring buffer with capacity number of lines, which are merged in
+		/// timestamp order and printed by a background thread, pushing blocks
+		/// while the thread's buffer is full unless set otherwise, see
+		/// setOverflow()
+		/// note: buffer capacity only applies to threads which have not logged
+		///       in async mode yet
+		static void startAsync(std::size_t capacity=LOG_ASYNC_CAPACITY) {
+			Async &async = Log::async();
+			if(async.running) {return;}
+			async.capacity = capacity;
+			async.running = true;
+			async.thread = new std::thread([&async] {
+				while(async.running) {
+					if(!drain(async, false)) {
+						flushSink(true);
+						std::this_thread::sleep_for(std::chrono::milliseconds(LOG_ASYNC_SLEEP));
+					}
+				}
+				drain(async, true);
+			});
+		}
+
+		/// stop async mode, prints any waiting lines before returning
+		static void stopAsync() {
+			Async &async = Log::async();
+			if(!async.running) {return;}
+			std::lock_guard<std::mutex> lock(async.stopMutex);
+			if(dedup().window.load()) {sweepDedup(true);} // print waiting repeats
+			async.running = false;
+			async.thread->join();
+			delete async.thread;
+			async.thread = nullptr;
+
+			// threads which saw running before it was cleared finish their
+			// push, draining makes room if they're blocked, later lines are
+			// printed directly once the last drain is done
+			while(pushing(async)) {
+				drain(async, true);
+				std::this_thread::yield();
+			}
+			drain(async, true);
+		}
+
+		/// is async mode running?
+		static bool isAsync() {return async().running;}
+
+		/// set what happens when a thread logs a line at level while it's
+		/// async ring buffer is full, the default is to block
+		///
+		/// dropped lines are counted per level and the backend thread prints
+		/// a warning with the counts, so lines are never dropped silently,
+		/// lines which would be dropped to make room for a new line are kept
+		/// aside for the backend thread if their level blocks, and the new
+		/// line waits if too many are kept, so keeping errors blocking means
+		/// they are never dropped:
+		///
+		///     // never stall on a slow disk, but keep every warning & error
+		///     Log::setOverflowBelow(Log::OVERFLOW_DROP_OLDEST, Log::LEVEL_WARN);
+		///
+		static void setOverflow(Level level, Overflow overflow) {
+			async().overflow[level - LEVEL_DEBUG] = (int)overflow;
+		}
+
+		/// set the overflow for all levels below a threshold, lines at or
+		/// above the threshold block
+		static void setOverflowBelow(Overflow overflow, Level threshold) {
+			for(int level = LEVEL_DEBUG; level <= LEVEL_ERROR; ++level) {
+				setOverflow((Level)level, (level < threshold ? overflow : OVERFLOW_BLOCK));
+			}
+		}
+
+		/// returns the overflow policy for a level
+		static Overflow getOverflow(Level level) {
+			return (Overflow)async().overflow[level - LEVEL_DEBUG].load();
+		}
+
+		/// returns the number of lines dropped at a level since starting
+		static std::uint64_t getDropped(Level level) {
+			return async().dropped[level - LEVEL_DEBUG].load();
+		}
+
+	/// \section Sinks
+
+		/// set the output sink, nullptr prints to the console
+		///
+		/// can be called at any time: the pointer is swapped so threads which
+		/// are logging keep going without a lock, then this waits until no
+		/// thread is still writing to the previous sink before flushing and
+		/// releasing it, ie. to reconfigure output at runtime, threads which
+		/// start writing after the swap are counted in the next epoch, so
+		/// they don't hold it up
+		/// note: don't call from within a Sink's write()
+		static void setSink(std::shared_ptr<Sink> sink) {
+			Output &output = Log::output();
+			std::lock_guard<std::mutex> lock(output.mutex);
+			Sink *previous = output.current.exchange(sink.get());
+			std::shared_ptr<Sink> retired = output.sink; // released after flushing
+			output.sink = sink;
+			// wait for the readers in both epochs, flipping to the other one
+			// first so threads which start reading meanwhile don't hold it up
+			for(int flip = 0; flip < 2; ++flip) {
+				unsigned int epoch = output.epoch.fetch_add(1) & 1;
+				for(int i = 0; i < LOG_SINK_READERS; ++i) {
+					while(output.readers[i].counts[epoch].load() != 0) {
+						std::this_thread::yield();
+					}
+				}
+			}
+			if(previous) {previous->flush();}
+		}
+
+		/// get the current output sink, nullptr if printing to the console
+		static std::shared_ptr<Sink> getSink() {
+			Output &output = Log::output();
+			std::lock_guard<std::mutex> lock(output.mutex);
+			return output.sink;
+		}
+
+		/// prefix lines with a "YYYY-MM-DD HH:MM:SS.mmm" local timestamp?
+		/// (default: false)
+		///
+		/// timestamps are taken from a cheap coarse monotonic clock in sync mode
+		/// or the async merge timestamp, and the date string is cached per
+		/// second, so they add little cost to the logging thread
+		static void setTimestamps(bool timestamps) {output().timestamps = timestamps;}
+
+		/// are lines prefixed with a timestamp?
+		static bool getTimestamps() {return output().timestamps;}
+
+		/// write out anything buffered by the current sink
+		static void flush() {flushSink(false);}
+
+		/// set the output format, applies to lines logged afterwards
+		static void setFormat(Format format) {output().format = format;}
+
+		/// returns the output format
+		static Format getFormat() {return output().format;}
+
+		/// format a message as text ie. "Warn: " level prefix followed by the
+		/// line or as a JSON object based on the output format, out can be a
+		/// std::string or Log::Line
+		template <class T> static void format(const Message &message, T &out) {
+			if(output().format.load(std::memory_order_relaxed) == FORMAT_JSON) {
+				formatJson(message, out);
+				return;
+			}
+			if(message.time) {
+				formatTime(message.time, out);
+				out.append(" ", 1);
+			}
+			const char *p = prefix(message.level);
+			out.append(p, std::strlen(p));
+			if(message.tag) {
+				out.append("[", 1);
+				out.append(message.tag, std::strlen(message.tag));
+				out.append("] ", 2);
+			}
+			out.append(message.text, message.size);
+		}
+
+		/// append a string with JSON escapes
+		template <class T> static void escape(const char *s, std::size_t size, T &out) {
+			static const char hex[] = "0123456789abcdef";
+			std::size_t start = 0;
+			for(std::size_t i = 0; i < size; ++i) {
+				unsigned char c = (unsigned char)s[i];
+				if(c >= 0x20 && c != '"' && c != '\\') {continue;}
+				out.append(s + start, i - start); // unescaped run
+				start = i + 1;
+				switch(c) {
+					case '"':  out.append("\\\"", 2); break;
+					case '\\': out.append("\\\\", 2); break;
+					case '\n': out.append("\\n", 2); break;
+					case '\r': out.append("\\r", 2); break;
+					case '\t': out.append("\\t", 2); break;
+					default: {
+						char text[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+						out.append(text, 6);
+					}
+				}
+			}
+			out.append(s + start, size - start);
+		}
+
+	/// \section Tags
+
+		/// returns the index for a tag name, registering it if needed
+		/// note: called once per statement by LOG_TAG_ID, returns 0 (untagged)
+		///       if there are already LOG_MAX_TAGS tags
+		static int tag(const std::string &name) {
+			Tags &tags = Log::tags();
+			std::lock_guard<std::mutex> lock(tags.mutex);
+			int count = tags.count.load();
+			for(int i = 1; i < count; ++i) {
+				if(tags.names[i] == name) {return i;}
+			}
+			if(count >= LOG_MAX_TAGS) {return 0;}
+			tags.names[count] = name;
+			tags.count.store(count + 1);
+			return count;
+		}
+
+		/// set the runtime level for a tag, overrides the global level
+		static void setTagLevel(const std::string &name, Level level) {
+			int index = tag(name);
+			if(index) {tags().levels[index] = (int)level;}
+		}
+
+		/// tag follows the global level again
+		static void resetTagLevel(const std::string &name) {
+			int index = tag(name);
+			if(index) {tags().levels[index] = TAG_INHERIT;}
+		}
+
+	/// \section Recorder
+
+		/// start the flight recorder: every line at all levels is copied into
+		/// a fixed-size per-thread circular buffer of the last lines, while
+		/// only lines at or above level which also pass the runtime & tag
+		/// filters are printed or sent to the sink,
+		/// the buffers are only written out by dumpRecorder() which is also
+		/// called on fatal signals if crash is true, see installCrashHandler()
+		///
+		/// recording a line is a copy into memory without locks or I/O, so
+		/// debug & verbose history is available after an incident without
+		/// paying to print it, note debug statements are compiled out unless
+		/// LOG_MIN_LEVEL allows them, ie. -DLOG_MIN_LEVEL=-2
+		///
+		/// note: the per-thread size is fixed by the first start
+		static void startRecorder(std::size_t lines=LOG_RECORDER_LINES,
+		                          Level level=LEVEL_WARN, bool crash=false) {
+			Recorder &recorder = Log::recorder();
+			std::lock_guard<std::mutex> lock(recorder.mutex);
+			if(recorder.lines == 0) {
+				recorder.lines = (lines > 0 ? lines : 1);
+			}
+			recorder.level = (int)level;
+			recorder.running = true;
+			if(crash) {installCrashHandler();}
+		}
+
+		/// stop recording, lines already recorded are kept
+		static void stopRecorder() {recorder().running = false;}
+
+		/// is the flight recorder running?
+		static bool isRecording() {return recording();}
+
+		/// write recorded lines from all threads in time order to a file
+		/// descriptor, stderr by default, lines being written while dumping
+		/// are skipped
+		/// note: async-signal-safe, no locks, allocation, or stdio
+		static void dumpRecorder(int fd=2) {
+			Recorder &recorder = Log::recorder();
+			std::int64_t offset = clockOffset(); // measured now to follow wall clock changes
+			std::uint64_t cursors[LOG_RECORDER_THREADS];
+			int threads = recorder.count.load(std::memory_order_acquire);
+			std::uint64_t lines = 0;
+			for(int t = 0; t < threads; ++t) {
+				RecorderBuffer &buffer = recorder.buffers[t];
+				std::uint64_t head = buffer.head.load(std::memory_order_acquire);
+				cursors[t] = (head > recorder.lines ? head - recorder.lines : 0);
+				lines += head - cursors[t];
+			}
+			char text[LOG_RECORDER_LINE_SIZE + 128];
+			std::size_t size = 0;
+			size = append(text, size, "--- flight recorder: ");
+			size = append(text, size, lines);
+			size = append(text, size, " lines ---\n");
+			writeFd(fd, text, size);
+			while(true) {
+				// pick the oldest next line across threads
+				int oldest = -1;
+				std::uint64_t oldestTime = 0;
+				for(int t = 0; t < threads; ++t) {
+					RecorderBuffer &buffer = recorder.buffers[t];
+					if(cursors[t] >= buffer.head.load(std::memory_order_acquire)) {continue;}
+					RecorderSlot &slot = buffer.slots.load()[cursors[t] % recorder.lines];
+					std::uint64_t time = slot.time;
+					if(oldest < 0 || time < oldestTime) {
+						oldest = t;
+						oldestTime = time;
+					}
+				}
+				if(oldest < 0) {break;}
+				RecorderBuffer &buffer = recorder.buffers[oldest];
+				RecorderSlot &slot = buffer.slots.load()[cursors[oldest]++ % recorder.lines];
+
+				// copy out, skipping slots being overwritten
+				std::uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+				if(sequence & 1) {continue;}
+				std::uint64_t time = (std::uint64_t)((std::int64_t)slot.time + offset);
+				Level level = slot.level;
+				int tag = slot.tag;
+				std::uint32_t length = slot.size;
+				if(length > LOG_RECORDER_LINE_SIZE) {length = LOG_RECORDER_LINE_SIZE;}
+				size = append(text, 0, time / 1000000000ULL);
+				text[size++] = '.';
+				unsigned int ms = (unsigned int)((time / 1000000ULL) % 1000);
+				text[size++] = (char)('0' + ms / 100);
+				text[size++] = (char)('0' + ms / 10 % 10);
+				text[size++] = (char)('0' + ms % 10);
+				text[size++] = ' ';
+				size = append(text, size, prefix(level));
+				if(tag > 0 && tag < LOG_MAX_TAGS) {
+					text[size++] = '[';
+					size = append(text, size, tags().names[tag].c_str(), 32);
+					text[size++] = ']';
+					text[size++] = ' ';
+				}
+				std::memcpy(text + size, slot.text, length);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if(slot.sequence.load(std::memory_order_relaxed) != sequence) {continue;}
+				size += length;
+				if(length == 0 || text[size - 1] != '\n') {text[size++] = '\n';}
+				writeFd(fd, text, size);
+			}
+		}
+
+	/// \section Crash
+
+		/// handle fatal signals (SIGSEGV, SIGBUS, SIGFPE, SIGILL & SIGABRT) by
+		/// writing what would otherwise be lost before the process dies, in
+		/// order: the sink's buffer via Sink::crashed(), async mode lines
+		/// which the backend thread hasn't printed yet, an error line naming
+		/// the signal, and the flight recorder to stderr if running
+		///
+		/// lines go to the sink's Sink::safeFd() if it has one, otherwise
+		/// to stderr
+		///
+		/// the handler only uses async-signal-safe calls, so waiting lines
+		/// are written as plain text without timestamps and binary mode lines
+		/// are skipped, the handlers which were installed before are then
+		/// restored and the signal is re-raised, so it reaches them or the
+		/// default action
+		/// note: POSIX only, best effort as the crashed thread may hold locks
+		static void installCrashHandler() {
+			#if !defined( __WIN32__ ) && !defined( _WIN32 )
+				CrashHandler &handler = crashHandler();
+				if(handler.installed) {return;}
+				struct sigaction action;
+				std::memset(&action, 0, sizeof(action));
+				action.sa_handler = crashed;
+				sigemptyset(&action.sa_mask);
+				for(int i = 0; i < CrashHandler::count; ++i) {
+					sigaction(handler.signals[i], &action, &handler.previous[i]);
+				}
+				handler.installed = true;
+			#endif
+			async(); // construct now instead of in the handler
+		}
+
+		/// restore the signal handlers replaced by installCrashHandler()
+		static void removeCrashHandler() {
+			#if !defined( __WIN32__ ) && !defined( _WIN32 )
+				CrashHandler &handler = crashHandler();
+				if(!handler.installed) {return;}
+				for(int i = 0; i < CrashHandler::count; ++i) {
+					sigaction(handler.signals[i], &handler.previous[i], nullptr);
+				}
+				handler.installed = false;
+			#endif
+		}
+
+		/// write async mode lines not yet printed by the backend thread to a
+		/// file descriptor, or by default to the sink's Sink::safeFd() and
+		/// otherwise stderr
+		/// note: async-signal-safe, binary mode lines are skipped
+		static void flushSafe(int fd=-1) {
+			Async &async = Log::async();
+			if(!async.running) {return;}
+			for(std::size_t i = 0; i < async.count && i < async.pending.size(); ++i) {
+				writeSafe(fd, async.pending[i]); // held back by the backend
+			}
+			for(std::size_t i = 0; i < async.queues.size(); ++i) {
+				for(std::size_t j = 0; j < async.queues[i]->kept.size(); ++j) {
+					writeSafe(fd, async.queues[i]->kept[j]);
+				}
+				while(async.queues[i]->buffer.pop([fd](Record &record) {
+					writeSafe(fd, record);
+				})) {}
+			}
+		}
+
+	/// \section Dedup
+
+		/// collapse repeats of the same line within a window of seconds into
+		/// a single "(repeated N times)" line, 0 disables (default)
+		///
+		/// the first line is printed as usual, identical lines at the same
+		/// level & tag are counted and dropped until the window ends, then
+		/// the count is printed when the line repeats again, by the async
+		/// backend thread, or on Log::flush(), checking a line costs a hash
+		/// of it's text & a lookup in a small lock-free table
+		///
+		/// note: binary mode lines are not deduplicated
+		static void setDedup(double seconds) {
+			dedup().window = (std::uint64_t)(seconds * 1000000000.0);
+		}
+
+		/// returns the dedup window in seconds
+		static double getDedup() {
+			return (double)dedup().window.load() / 1000000000.0;
+		}
+
+	/// \section Binary
+
+		/// register a binary mode statement site, returns the site id
+		/// note: called once per statement by LOG_SITE
+		static unsigned int site(const char *file, int line) {
+			Sites &sites = Log::sites();
+			std::lock_guard<std::mutex> lock(sites.mutex);
+			sites.sites.push_back(Site{file, line});
+			return (unsigned int)sites.sites.size();
+		}
+
+		/// write binary mode lines to a binary file instead of decoding them to
+		/// text, text lines are still printed, returns false on open error
+		static bool openBinaryFile(const std::string &path) {
+			BinaryFile &file = binaryFile();
+			std::lock_guard<std::mutex> lock(file.mutex);
+			file.close();
+			file.file = std::fopen(path.c_str(), "wb");
+			if(!file.file) {return false;}
+			std::fwrite(BINARY_MAGIC, 1, 4, file.file);
+			put(file.file, (std::uint8_t)BINARY_VERSION);
+			file.open = true;
+			return true;
+		}
+
+		/// close the binary file, binary mode lines are decoded to text again
+		static void closeBinaryFile() {
+			BinaryFile &file = binaryFile();
+			std::lock_guard<std::mutex> lock(file.mutex);
+			file.close();
+		}
+
+		/// decode binary file lines written by openBinaryFile() to text,
+		/// optionally prefixes each line with it's statement's file & line,
+		/// returns false if the file is not a binary log or is truncated
+		/// note: the file must be decoded on a machine with the same byte order
+		static bool decodeBinaryFile(std::istream &in, std::ostream &out, bool showSites=false) {
+			char magic[4];
+			std::uint8_t version = 0;
+			if(!in.read(magic, 4) || std::memcmp(magic, BINARY_MAGIC, 4) != 0 ||
+			   !get(in, version) || version != BINARY_VERSION) {
+				return false;
+			}
+			std::unordered_map<std::uint32_t, std::string> sites;
+			std::unordered_map<std::uint64_t, std::string> literals;
+			std::string data;
+			Line line;
+			char type;
+			while(in.get(type)) {
+				switch(type) {
+					case ENTRY_SITE: {
+						std::uint32_t id, number, size;
+						if(!get(in, id) || !get(in, number) || !get(in, size)) {return false;}
+						data.resize(size);
+						if(size > 0 && !in.read(&data[0], size)) {return false;}
+						sites[id] = data + ":" + std::to_string(number) + ": ";
+						break;
+					}
+					case ENTRY_LITERAL: {
+						std::uint64_t key;
+						std::uint32_t size;
+						if(!get(in, key) || !get(in, size)) {return false;}
+						data.resize(size);
+						if(size > 0 && !in.read(&data[0], size)) {return false;}
+						literals[key] = data;
+						break;
+					}
+					case ENTRY_LINE: {
+						std::int8_t level;
+						std::uint32_t id, size;
+						if(!get(in, level) || !get(in, id) || !get(in, size)) {return false;}
+						data.resize(size);
+						if(size > 0 && !in.read(&data[0], size)) {return false;}
+						line.clear();
+						decode(data.data(), data.size(), line, [&literals](std::uint64_t key) {
+							std::unordered_map<std::uint64_t, std::string>::const_iterator iter = literals.find(key);
+							return iter == literals.end() ? "" : iter->second.c_str();
+						});
+						out << prefix((Level)level);
+						if(showSites) {out << sites[id];}
+						out.write(line.data(), line.size());
+						break;
+					}
+					default:
+						return false;
+				}
+			}
+			return true;
+		}
+
+		/// returns the text prefix for a level
+		static const char* prefix(Level level) {
+			switch(level) {
+				case LEVEL_DEBUG: return "Debug: ";
+				case LEVEL_WARN:  return "Warn: ";
+				case LEVEL_ERROR: return "Error: ";
+				default:          return "";
+			}
+		}
+
+	private:
+
+		/// flush the current sink, or let it decide when idle is set, which
+		/// the async backend thread does when it runs out of lines
+		static void flushSink(bool idle) {
+			if(dedup().window.load(std::memory_order_relaxed)) {sweepDedup(false);}
+			Reading reading;
+			Sink *sink = output().current.load();
+			if(sink) {
+				if(idle) {sink->idle();}
+				else {sink->flush();}
+			}
+			else {
+				std::cout.flush();
+				std::cerr.flush();
+			}
+		}
+
+		/// a finished line waiting in the async ring buffer
+		struct Record {
+			Level level = LEVEL_NORMAL;
+			unsigned int site = 0;  ///< binary mode site id or 0 for text
+			int tag = 0;            ///< tag index or 0 for untagged
+			std::uint64_t time = 0; ///< monotonic timestamp in ns for merging
+			std::size_t fields = 0; ///< JSON fields size at the end of line
+			std::string line;
+		};
+
+		/// a producer thread's ring buffer, closed when the thread exits
+		struct Queue {
+			RingBuffer<Record> buffer;
+			std::atomic<bool> closed;
+			std::vector<Record> kept; ///< blocking lines evicted by OVERFLOW_DROP_OLDEST
+			std::mutex mutex;         ///< kept & evicting mutex
+			std::atomic<bool> pushing; ///< is the thread pushing a line?
+			Queue(std::size_t capacity) : buffer(capacity), closed(false), pushing(false) {}
+		};
+
+		/// async mode state
+		struct Async {
+			std::thread *thread = nullptr;  ///< backend thread
+			std::atomic<bool> running;      ///< is the thread running?
+			std::atomic<std::size_t> capacity; ///< new per-thread buffer capacity
+			std::vector<std::shared_ptr<Queue>> queues; ///< producer buffers
+			std::mutex mutex;               ///< queues mutex
+			std::mutex stopMutex;           ///< held while stopping
+
+			/// backend merge buffers, lines are swapped in and out of the
+			/// ring buffers so their string capacity is reused
+			std::vector<Record> pending; ///< lines waiting to be printed
+			std::vector<Record> spare;   ///< lines held back for the next round
+			std::vector<std::size_t> order; ///< pending indices in time order
+			std::size_t count = 0;       ///< number of pending lines
+
+			/// per-level overflow policies & dropped line counts
+			std::atomic<int> overflow[5];
+			std::atomic<std::uint64_t> dropped[5];
+			std::uint64_t reported[5];   ///< dropped counts already reported
+			std::uint64_t reportTime = 0; ///< last dropped report time in ns
+
+			Async() : running(false), capacity(LOG_ASYNC_CAPACITY) {
+				// construct the state used when draining first, so it's
+				// destroyed after this at exit
+				output();
+				tags();
+				sites();
+				dedup();
+				recorder();
+				binaryFile();
+				for(int i = 0; i < 5; ++i) {
+					overflow[i].store(OVERFLOW_BLOCK);
+					dropped[i].store(0);
+					reported[i] = 0;
+				}
+			}
+			~Async() {stopAsync();}
+		};
+
+		/// shared async state, function static so no .cpp storage is needed
+		static Async& async() {
+			static Async async;
+			return async;
+		}
+
+		/// returns true if any thread is pushing a line
+		static bool pushing(Async &async) {
+			std::lock_guard<std::mutex> lock(async.mutex);
+			for(std::size_t i = 0; i < async.queues.size(); ++i) {
+				if(async.queues[i]->pushing) {return true;}
+			}
+			return false;
+		}
+
+		/// returns the calling thread's queue,
+		/// registers it with the backend on first use
+		static Queue& producer(Async &async) {
+			struct Producer {
+				std::shared_ptr<Queue> queue;
+				~Producer() {
+					if(queue) {queue->closed = true;}
+				}
+			};
+			static thread_local Producer producer;
+			if(!producer.queue) {
+				producer.queue = std::make_shared<Queue>(async.capacity.load());
+				std::lock_guard<std::mutex> lock(async.mutex);
+				async.queues.push_back(producer.queue);
+			}
+			return *producer.queue;
+		}
+
+		/// monotonic time in ns
+		static std::uint64_t now() {
+			return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/// coarse monotonic time in ns, only updated every few ms but much
+		/// cheaper to read on Linux, otherwise same as now()
+		static std::uint64_t coarse() {
+			#ifdef CLOCK_MONOTONIC_COARSE
+				struct timespec ts;
+				clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+				return (std::uint64_t)ts.tv_sec * 1000000000ULL + (std::uint64_t)ts.tv_nsec;
+			#else
+				return now();
+			#endif
+		}
+
+		/// returns the wall clock - monotonic time offset in ns
+		static std::int64_t clockOffset() {
+			return (std::int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count() - (std::int64_t)now();
+		}
+
+		/// the clock offset used for timestamps & when it was measured
+		struct Clock {
+			std::atomic<std::int64_t> offset;
+			std::atomic<std::uint64_t> measured; ///< monotonic time in ns
+			Clock() : offset(clockOffset()), measured(now()) {}
+		};
+
+		/// shared clock offset, function static so no .cpp storage is needed
+		static Clock& clock() {
+			static Clock clock;
+			return clock;
+		}
+
+		/// convert monotonic time to wall clock time if timestamps are on,
+		/// the offset between the clocks is measured again every second, so
+		/// wall clock changes ie. NTP steps are picked up
+		/// note: assumes CLOCK_MONOTONIC_COARSE & std::chrono::steady_clock
+		///       share a base, as they do on Linux
+		static std::uint64_t timestamp(std::uint64_t monotonic) {
+			if(!output().timestamps.load(std::memory_order_relaxed)) {return 0;}
+			Clock &clock = Log::clock();
+			std::uint64_t measured = clock.measured.load(std::memory_order_relaxed);
+			if((std::int64_t)(monotonic - measured) > 1000000000LL &&
+			   clock.measured.compare_exchange_strong(measured, monotonic, std::memory_order_relaxed)) {
+				clock.offset.store(clockOffset(), std::memory_order_relaxed); // one thread measures
+			}
+			return (std::uint64_t)((std::int64_t)monotonic + clock.offset.load(std::memory_order_relaxed));
+		}
+
+		/// current wall clock time if timestamps are on, otherwise 0 without
+		/// reading the clock
+		static std::uint64_t timestamp() {
+			if(!output().timestamps.load(std::memory_order_relaxed)) {return 0;}
+			return timestamp(coarse());
+		}
+
+		/// append "YYYY-MM-DD HH:MM:SS.mmm" local time,
+		/// the date & time string is only reformatted once per second
+		template <class T> static void formatTime(std::uint64_t time, T &out) {
+			struct Cache {
+				std::time_t seconds = -1;
+				char text[32];
+				std::size_t size = 0;
+			};
+			static thread_local Cache cache;
+			std::time_t seconds = (std::time_t)(time / 1000000000ULL);
+			if(seconds != cache.seconds) {
+				struct tm local;
+				#if defined( __WIN32__ ) || defined( _WIN32 )
+					localtime_s(&local, &seconds);
+				#else
+					localtime_r(&seconds, &local);
+				#endif
+				cache.size = std::strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &local);
+				cache.seconds = seconds;
+			}
+			unsigned int ms = (unsigned int)((time / 1000000ULL) % 1000);
+			char text[4] = {'.', (char)('0' + ms / 100), (char)('0' + ms / 10 % 10), (char)('0' + ms % 10)};
+			out.append(cache.text, cache.size);
+			out.append(text, 4);
+		}
+
+		/// format a message as a JSON object followed by a newline:
+		/// {"time":"...","level":"warn","tag":"net","msg":"...",<fields>}
+		/// a trailing newline in the line text is left out of msg
+		template <class T> static void formatJson(const Message &message, T &out) {
+			out.append("{", 1);
+			if(message.time) {
+				out.append("\"time\":\"", 8);
+				formatTime(message.time, out);
+				out.append("\",", 2);
+			}
+			const char *name = levelName(message.level);
+			out.append("\"level\":\"", 9);
+			out.append(name, std::strlen(name));
+			if(message.tag) {
+				out.append("\",\"tag\":\"", 9);
+				escape(message.tag, std::strlen(message.tag), out);
+			}
+			std::size_t size = message.size;
+			if(size > 0 && message.text[size - 1] == '\n') {size--;}
+			out.append("\",\"msg\":\"", 9);
+			escape(message.text, size, out);
+			out.append("\"", 1);
+			if(message.fieldsSize) {
+				out.append(message.fields, message.fieldsSize);
+			}
+			out.append("}\n", 2);
+		}
+
+		/// returns the lowercase level name for JSON output
+		static const char* levelName(Level level) {
+			switch(level) {
+				case LEVEL_DEBUG:   return "debug";
+				case LEVEL_VERBOSE: return "verbose";
+				case LEVEL_WARN:    return "warn";
+				case LEVEL_ERROR:   return "error";
+				default:            return "normal";
+			}
+		}
+
+		/// handle a full ring buffer based on the line's level overflow policy,
+		/// returns true to try pushing again
+		bool overflow(Async &async, Queue &queue) {
+			switch(async.overflow[m_level - LEVEL_DEBUG].load(std::memory_order_relaxed)) {
+				case OVERFLOW_DROP_NEWEST:
+					async.dropped[m_level - LEVEL_DEBUG]++;
+					return false;
+				case OVERFLOW_DROP_OLDEST: {
+					// blocking lines can't be dropped, they're moved aside for
+					// the backend thread, unless that's full too
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					std::size_t capacity = queue.buffer.capacity();
+					if(queue.kept.size() < capacity) {
+						queue.buffer.pop([&async, &queue, capacity](Record &record) {
+							if(async.overflow[record.level - LEVEL_DEBUG].load(std::memory_order_relaxed) ==
+							   OVERFLOW_BLOCK) {
+								if(queue.kept.capacity() == 0) {queue.kept.reserve(capacity);}
+								queue.kept.push_back(Record());
+								Record &kept = queue.kept.back();
+								kept.level = record.level;
+								kept.site = record.site;
+								kept.tag = record.tag;
+								kept.fields = record.fields;
+								kept.time = record.time;
+								kept.line.swap(record.line);
+								return;
+							}
+							async.dropped[record.level - LEVEL_DEBUG]++;
+						});
+						return true;
+					}
+				}
+				// fall through - wait instead
+				default:
+					std::this_thread::yield(); // wait for the backend
+					return true;
+			}
+		}
+
+		/// print a warning if lines were dropped since the last report, at
+		/// most once a second unless all is true
+		static void reportDropped(Async &async, bool all) {
+			std::uint64_t time = now();
+			if(!all && time - async.reportTime < 1000000000ULL) {return;}
+			async.reportTime = time;
+			std::uint64_t counts[5], total = 0;
+			for(int i = 0; i < 5; ++i) {
+				std::uint64_t dropped = async.dropped[i].load(std::memory_order_relaxed);
+				counts[i] = dropped - async.reported[i];
+				async.reported[i] = dropped;
+				total += counts[i];
+			}
+			if(total == 0) {return;}
+			static const char *names[5] = {"debug", "verbose", "normal", "warn", "error"};
+			Line line;
+			line.append("Log: dropped ", 13);
+			format(line, total);
+			line.append(" lines while the async buffer was full (", 40);
+			bool first = true;
+			for(int i = 0; i < 5; ++i) {
+				if(counts[i] == 0) {continue;}
+				if(!first) {line.append(", ", 2);}
+				first = false;
+				line.append(names[i], std::strlen(names[i]));
+				line.append(' ');
+				format(line, counts[i]);
+			}
+			line.append(")\n", 2);
+			dispatch(LEVEL_WARN, 0, 0, line.data(), line.size(), 0, timestamp(now()));
+		}
+
+		/// collect waiting lines from all threads and print them in timestamp
+		/// order, lines newer than the merge window are held back for the next
+		/// round unless all is true, returns true if any lines were collected
+		static bool drain(Async &async, bool all) {
+			std::uint64_t cutoff = now() - (std::uint64_t)LOG_ASYNC_MERGE_WINDOW * 1000;
+			std::size_t collected = async.count;
+			{
+				std::lock_guard<std::mutex> lock(async.mutex);
+				std::vector<std::shared_ptr<Queue>>::iterator iter = async.queues.begin();
+				while(iter != async.queues.end()) {
+					Queue &queue = *(*iter);
+					bool closed = queue.closed; // check before popping the last lines
+					auto collect = [&async](Record &record) {
+						if(async.count == async.pending.size()) {
+							async.pending.push_back(Record());
+						}
+						Record &pending = async.pending[async.count++];
+						pending.level = record.level;
+						pending.site = record.site;
+						pending.tag = record.tag;
+						pending.fields = record.fields;
+						pending.time = record.time;
+						pending.line.swap(record.line);
+					};
+					{
+						std::lock_guard<std::mutex> queueLock(queue.mutex); // kept lines are older
+						for(Record &record : queue.kept) {collect(record);}
+						queue.kept.clear();
+						while(queue.buffer.pop(collect)) {}
+					}
+					if(closed) {
+						iter = async.queues.erase(iter);
+						continue;
+					}
+					iter++;
+				}
+			}
+			bool any = async.count > collected;
+			if(!any && !all && async.count == 0) {return false;}
+
+			// sort by time, ties keep collection order which is per-thread order
+			std::vector<Record> &pending = async.pending;
+			async.order.resize(async.count);
+			for(std::size_t i = 0; i < async.count; ++i) {
+				async.order[i] = i;
+			}
+			std::sort(async.order.begin(), async.order.end(), [&pending](std::size_t a, std::size_t b) {
+				return pending[a].time < pending[b].time ||
+				      (pending[a].time == pending[b].time && a < b);
+			});
+
+			// print, holding back recent lines unless idle or stopping
+			bool flushing = all || !any;
+			std::size_t i = 0;
+			for(; i < async.count; ++i) {
+				Record &record = pending[async.order[i]];
+				if(!flushing && record.time > cutoff) {break;}
+				dispatch(record.level, record.site, record.tag, record.line.data(),
+				         record.line.size(), record.fields, timestamp(record.time));
+			}
+
+			// keep the rest in order for the next round
+			std::size_t kept = 0;
+			for(; i < async.count; ++i) {
+				if(kept == async.spare.size()) {
+					async.spare.push_back(Record());
+				}
+				Record &record = pending[async.order[i]];
+				Record &spare = async.spare[kept++];
+				spare.level = record.level;
+				spare.site = record.site;
+				spare.tag = record.tag;
+				spare.fields = record.fields;
+				spare.time = record.time;
+				spare.line.swap(record.line);
+			}
+			async.pending.swap(async.spare);
+			async.count = kept;
+			reportDropped(async, all);
+			return any;
+		}
+
+		/// print a finished line, binary mode lines are written to the binary
+		/// file if it's open, otherwise they are decoded to text first
+		static void dispatch(Level level, unsigned int site, int tag, const char *line,
+		                     std::size_t size, std::size_t fields, std::uint64_t time) {
+			const char *name = (tag ? tags().names[tag].c_str() : nullptr);
+			if(site) {
+				BinaryFile &file = binaryFile();
+				if(file.open && file.write(level, site, line, size)) {
+					return;
+				}
+				Line text;
+				decode(line, size, text, [](std::uint64_t key) {
+					return (const char *)(std::uintptr_t)key;
+				});
+				write(Message{level, text.data(), text.size(), time, name, nullptr, 0});
+				return;
+			}
+			write(Message{level, line, size - fields, time, name, line + size - fields, fields});
+		}
+
+		/// write a message to the current sink or print to the console
+		static void write(const Message &message) {
+			Reading reading;
+			Sink *sink = output().current.load();
+			if(sink) {
+				sink->write(message);
+			}
+			else {
+				print(message);
+			}
+		}
+
+		/// print a message to the console based on level:
+		/// debug, verbose & normal to std::cout, warn & error to std::cerr
+		static void print(const Message &message) {
+			Line line;
+			format(message, line);
+			if(message.level >= LEVEL_WARN) {
+				std::cerr.write(line.data(), line.size());
+				LOG_FLUSH_CERR
+			}
+			else {
+				std::cout.write(line.data(), line.size());
+				LOG_FLUSH_COUT
+			}
+		}
+
+		/// tag level value to follow the global level
+		static const int TAG_INHERIT = 100;
+
+		/// tag names and levels, indexed by tag id so the filter is a
+		/// single array load, names are written once and never change
+		struct Tags {
+			std::atomic<int> levels[LOG_MAX_TAGS];
+			std::string names[LOG_MAX_TAGS];
+			std::atomic<int> count; ///< number of tags including untagged
+			std::mutex mutex;       ///< registration mutex
+			Tags() : count(1) {
+				for(int i = 0; i < LOG_MAX_TAGS; ++i) {
+					levels[i].store(TAG_INHERIT);
+				}
+			}
+		};
+
+		/// shared tag table, function static so no .cpp storage is needed
+		static Tags& tags() {
+			static Tags tags;
+			return tags;
+		}
+
+		/// a recorded line, the sequence is odd while being written
+		struct RecorderSlot {
+			std::atomic<std::uint32_t> sequence{0};
+			Level level = LEVEL_NORMAL;
+			int tag = 0;
+			std::uint64_t time = 0; ///< monotonic time in ns
+			std::uint32_t size = 0;
+			char text[LOG_RECORDER_LINE_SIZE];
+		};
+
+		/// a thread's recorded lines, reused after the thread exits
+		struct RecorderBuffer {
+			std::atomic<RecorderSlot*> slots{nullptr};
+			std::atomic<std::uint64_t> head{0}; ///< number of lines recorded
+			std::atomic<bool> used{false};      ///< owned by a thread?
+		};
+
+		/// flight recorder state, buffers are a fixed array so they can be read
+		/// from a signal handler
+		struct Recorder {
+			std::atomic<bool> running{false};
+			std::atomic<int> level{LEVEL_WARN}; ///< print lines at or above
+			std::size_t lines = 0;              ///< lines per thread
+			RecorderBuffer buffers[LOG_RECORDER_THREADS];
+			std::atomic<int> count{0};          ///< number of buffers in use
+			std::mutex mutex;
+		};
+
+		/// shared flight recorder, function static so no .cpp storage is needed
+		static Recorder& recorder() {
+			static Recorder recorder;
+			return recorder;
+		}
+
+		#if !defined( __WIN32__ ) && !defined( _WIN32 )
+		/// fatal signals caught by the crash handler & the actions they replaced
+		struct CrashHandler {
+			static const int count = 5;
+			int signals[count] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+			struct sigaction previous[count]; ///< restored when a signal is caught
+			bool installed = false;
+		};
+
+		/// crash handler state, function static so no .cpp storage is needed
+		static CrashHandler& crashHandler() {
+			static CrashHandler handler;
+			return handler;
+		}
+		#endif
+
+		/// is the flight recorder running?
+		static bool recording() {
+			return recorder().running.load(std::memory_order_relaxed);
+		}
+
+		/// returns the calling thread's recorder buffer or nullptr if there
+		/// are already LOG_RECORDER_THREADS buffers in use
+		static RecorderBuffer* recorderBuffer() {
+			struct Owner {
+				RecorderBuffer *buffer = nullptr;
+				~Owner() {
+					if(buffer) {buffer->used = false;}
+				}
+			};
+			static thread_local Owner owner;
+			if(owner.buffer) {return owner.buffer;}
+			Recorder &recorder = Log::recorder();
+			std::lock_guard<std::mutex> lock(recorder.mutex);
+			int count = recorder.count.load();
+			for(int i = 0; i <= count && i < LOG_RECORDER_THREADS; ++i) {
+				RecorderBuffer &buffer = recorder.buffers[i];
+				if(buffer.used) {continue;}
+				buffer.used = true;
+				if(!buffer.slots.load()) {
+					buffer.slots = new RecorderSlot[recorder.lines];
+				}
+				if(i == count) {recorder.count.store(count + 1, std::memory_order_release);}
+				owner.buffer = &buffer;
+				return owner.buffer;
+			}
+			return nullptr;
+		}
+
+		/// copy the line into the calling thread's recorder buffer,
+		/// returns true if the line should also be printed
+		bool record() {
+			Recorder &recorder = Log::recorder();
+			RecorderBuffer *buffer = recorderBuffer();
+			if(buffer) {
+				Line text;
+				const char *data = m_line.data();
+				std::size_t size = m_line.size();
+				if(m_site) { // decode binary mode lines
+					decode(data, size, text, [](std::uint64_t key) {
+						return (const char *)(std::uintptr_t)key;
+					});
+					data = text.data();
+					size = text.size();
+				}
+				if(size > LOG_RECORDER_LINE_SIZE) {size = LOG_RECORDER_LINE_SIZE;}
+				std::uint64_t head = buffer->head.load(std::memory_order_relaxed);
+				RecorderSlot &slot = buffer->slots.load(std::memory_order_relaxed)[head % recorder.lines];
+				std::uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+				slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				slot.level = m_level;
+				slot.tag = m_tag.index;
+				slot.time = now();
+				slot.size = (std::uint32_t)size;
+				std::memcpy(slot.text, data, size);
+				slot.sequence.store(sequence + 2, std::memory_order_release);
+				buffer->head.store(head + 1, std::memory_order_release);
+			}
+			return m_level >= recorder.level.load(std::memory_order_relaxed);
+		}
+
+		/// fatal signal handler, writes anything waiting, restores the
+		/// previous handler, then re-raises so it runs once this one returns
+		static void crashed(int signal) {
+			Sink *sink = output().current.load(std::memory_order_acquire);
+			if(sink) {sink->crashed();} // older than the waiting lines
+			flushSafe();
+			Safe(LEVEL_ERROR, safeFd(LEVEL_ERROR)) << "caught fatal signal " << signal;
+			if(recording()) {dumpRecorder(2);}
+			#if !defined( __WIN32__ ) && !defined( _WIN32 )
+				CrashHandler &handler = crashHandler();
+				for(int i = 0; i < CrashHandler::count; ++i) {
+					if(handler.signals[i] != signal) {continue;}
+					struct sigaction previous = handler.previous[i];
+					if(!(previous.sa_flags & SA_SIGINFO) && previous.sa_handler == SIG_IGN) {
+						previous.sa_handler = SIG_DFL; // a fatal signal can't be ignored
+					}
+					sigaction(signal, &previous, nullptr);
+				}
+			#else
+				std::signal(signal, SIG_DFL);
+			#endif
+			std::raise(signal);
+		}
+
+		/// returns the current sink's Sink::safeFd() for a level or stderr
+		static int safeFd(Level level) {
+			Sink *sink = output().current.load(std::memory_order_acquire);
+			int fd = (sink ? sink->safeFd(level) : -1);
+			return (fd >= 0 ? fd : 2);
+		}
+
+		/// write a waiting record as text to a file descriptor, or the
+		/// current sink's safe fd if it's -1, async-signal-safe
+		static void writeSafe(int fd, const Record &record) {
+			if(record.site) {return;}
+			if(fd < 0) {fd = safeFd(record.level);}
+			const char *p = prefix(record.level);
+			writeFd(fd, p, std::strlen(p));
+			if(record.tag > 0 && record.tag < LOG_MAX_TAGS) {
+				const std::string &tag = tags().names[record.tag];
+				writeFd(fd, "[", 1);
+				writeFd(fd, tag.data(), tag.size());
+				writeFd(fd, "] ", 2);
+			}
+			std::size_t size = record.line.size() - record.fields;
+			writeFd(fd, record.line.data(), size);
+			if(size == 0 || record.line[size - 1] != '\n') {writeFd(fd, "\n", 1);}
+		}
+
+		/// write all bytes to a file descriptor, async-signal-safe
+		static void writeFd(int fd, const char *data, std::size_t size) {
+			while(size > 0) {
+				#if defined( __WIN32__ ) || defined( _WIN32 )
+					int written = _write(fd, data, (unsigned int)size);
+				#else
+					ssize_t written = ::write(fd, data, size);
+				#endif
+				if(written < 0) {
+					if(errno == EINTR) {continue;}
+					return;
+				}
+				data += written;
+				size -= (std::size_t)written;
+			}
+		}
+
+		/// append a string to a text buffer up to max chars, async-signal-safe
+		static std::size_t append(char *text, std::size_t size, const char *s,
+		                          std::size_t max=64) {
+			for(std::size_t i = 0; s[i] && i < max; ++i) {
+				text[size++] = s[i];
+			}
+			return size;
+		}
+
+		/// append an unsigned integer to a text buffer, async-signal-safe,
+		/// converts two digits per division
+		static std::size_t append(char *text, std::size_t size, std::uint64_t value) {
+			static const char pairs[] =
+				"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+				"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+				"8081828384858687888990919293949596979899";
+			char digits[20];
+			int count = 20;
+			while(value >= 100) {
+				std::size_t pair = (std::size_t)(value % 100) * 2;
+				value /= 100;
+				digits[--count] = pairs[pair + 1];
+				digits[--count] = pairs[pair];
+			}
+			if(value >= 10) {
+				digits[--count] = pairs[value * 2 + 1];
+				digits[--count] = pairs[value * 2];
+			}
+			else {
+				digits[--count] = (char)('0' + value);
+			}
+			std::memcpy(text + size, digits + count, 20 - count);
+			return size + 20 - count;
+		}
+
+		/// a dedup hash table slot, only the hash, start, and repeats are
+		/// used to check lines, the rest is a copy of the line for printing
+		/// the repeats and is guarded by busy
+		struct DedupSlot {
+			std::atomic<std::uint64_t> hash{0};    ///< line hash, 0 if empty
+			std::atomic<std::uint64_t> start{0};   ///< window start in ns
+			std::atomic<std::uint64_t> repeats{0}; ///< lines dropped in window
+			std::atomic<bool> busy{false};
+			Level level = LEVEL_NORMAL;
+			int tag = 0;
+			std::size_t size = 0;
+			char text[LOG_DEDUP_TEXT_SIZE];
+		};
+
+		/// dedup state
+		struct Dedup {
+			std::atomic<std::uint64_t> window{0}; ///< window in ns, 0 to disable
+			std::atomic<std::uint64_t> swept{0};  ///< last sweep time in ns
+			DedupSlot slots[LOG_DEDUP_SLOTS];
+		};
+
+		/// shared dedup state, function static so no .cpp storage is needed
+		static Dedup& dedup() {
+			static Dedup dedup;
+			return dedup;
+		}
+
+		/// returns true if this line repeats one in the current window and
+		/// should be dropped
+		bool duplicate() {
+			if(m_site) {return false;}
+			Dedup &dedup = Log::dedup();
+			std::uint64_t window = dedup.window.load(std::memory_order_relaxed);
+			std::uint64_t time = coarse();
+			std::uint64_t swept = dedup.swept.load(std::memory_order_relaxed);
+			if(time - swept >= window && dedup.swept.compare_exchange_strong(swept, time)) {
+				sweepDedup(false);
+			}
+
+			std::uint64_t hash = hashLine();
+			const std::size_t mask = LOG_DEDUP_SLOTS - 1;
+			DedupSlot *empty = nullptr;
+			for(std::size_t probe = 0; probe < 4; ++probe) {
+				DedupSlot &slot = dedup.slots[(hash + probe) & mask];
+				std::uint64_t key = slot.hash.load(std::memory_order_acquire);
+				std::uint64_t start = slot.start.load(std::memory_order_relaxed);
+				if(key == hash) {
+					if(time < start || time - start < window) {
+						slot.repeats.fetch_add(1, std::memory_order_relaxed);
+						return true;
+					}
+					// window over, start a new one with this line
+					if(slot.start.compare_exchange_strong(start, time)) {
+						reportRepeats(slot);
+					}
+					return false;
+				}
+				if(!empty && (key == 0 || (time >= start && time - start >= window))) {empty = &slot;}
+			}
+			if(empty && !empty->busy.exchange(true, std::memory_order_acquire)) {
+				// evict the expired line and take it's slot
+				std::uint64_t repeats = empty->repeats.exchange(0);
+				if(repeats) {printRepeats(*empty, repeats);}
+				empty->level = m_level;
+				empty->tag = m_tag.index;
+				empty->size = (m_line.size() < LOG_DEDUP_TEXT_SIZE ? m_line.size() : LOG_DEDUP_TEXT_SIZE);
+				std::memcpy(empty->text, m_line.data(), empty->size);
+				empty->start.store(time, std::memory_order_relaxed);
+				empty->hash.store(hash, std::memory_order_release);
+				empty->busy.store(false, std::memory_order_release);
+			}
+			return false;
+		}
+
+		/// hash the line, fields, level & tag 8 bytes at a time, never 0
+		std::uint64_t hashLine() const {
+			std::uint64_t hash = ((std::uint64_t)(m_level + 3) << 32) ^ (std::uint64_t)m_tag.index;
+			const Line *lines[2] = {&m_line, &m_fields};
+			for(const Line *line : lines) {
+				const char *p = line->data();
+				std::size_t size = line->size();
+				std::uint64_t word;
+				for(; size >= 8; p += 8, size -= 8) {
+					std::memcpy(&word, p, 8);
+					hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+					hash ^= hash >> 32;
+				}
+				word = size;
+				std::memcpy(&word, p, size);
+				hash = (hash ^ word ^ ((std::uint64_t)size << 56)) * 0x9E3779B97F4A7C15ULL;
+				hash ^= hash >> 32;
+			}
+			return hash ? hash : 1;
+		}
+
+		/// print a slot's repeat count if any
+		static void reportRepeats(DedupSlot &slot) {
+			if(slot.busy.exchange(true, std::memory_order_acquire)) {return;}
+			std::uint64_t repeats = slot.repeats.exchange(0);
+			if(repeats) {printRepeats(slot, repeats);}
+			slot.busy.store(false, std::memory_order_release);
+		}
+
+		/// print "(repeated N times) line" for a slot, busy must be set
+		static void printRepeats(const DedupSlot &slot, std::uint64_t repeats) {
+			Log log(slot.level, Tag{slot.tag});
+			log.m_dedup = false;
+			log << "(repeated " << repeats << " times) ";
+			log.m_line.append(slot.text, slot.size);
+			if(slot.size == LOG_DEDUP_TEXT_SIZE && slot.text[slot.size - 1] != '\n') {
+				log.m_line.append("...\n", 4); // truncated
+			}
+		}
+
+		/// print repeat counts for slots whose window is over, or all if all
+		/// is true
+		static void sweepDedup(bool all) {
+			Dedup &dedup = Log::dedup();
+			std::uint64_t window = dedup.window.load(std::memory_order_relaxed);
+			std::uint64_t time = coarse();
+			for(std::size_t i = 0; i < LOG_DEDUP_SLOTS; ++i) {
+				DedupSlot &slot = dedup.slots[i];
+				if(slot.repeats.load(std::memory_order_relaxed) == 0) {continue;}
+				std::uint64_t start = slot.start.load(std::memory_order_relaxed);
+				if(all || (time >= start && time - start >= window)) {reportRepeats(slot);}
+			}
+		}
+
+		/// number of threads using the current sink per epoch, padded to keep
+		/// threads on separate cache lines
+		struct Readers {
+			std::atomic<std::uint32_t> counts[2];
+			char pad[64 - 2 * sizeof(std::atomic<std::uint32_t>)];
+		};
+
+		/// output sink state
+		struct Output {
+			std::shared_ptr<Sink> sink;   ///< owns the current sink, mutex
+			std::atomic<Sink*> current;   ///< current sink for fast reads
+			std::atomic<bool> timestamps; ///< prefix lines with the time?
+			std::atomic<Format> format;   ///< output format
+			Readers readers[LOG_SINK_READERS]; ///< shared round robin by threads
+			std::atomic<unsigned int> threads; ///< number of reading threads
+			std::atomic<unsigned int> epoch;   ///< reader count in use, flipped by setSink()
+			std::mutex mutex;             ///< sink swap mutex
+			Output() : current(nullptr), timestamps(false), format(FORMAT_TEXT), threads(0), epoch(0) {
+				for(int i = 0; i < LOG_SINK_READERS; ++i) {
+					readers[i].counts[0].store(0, std::memory_order_relaxed);
+					readers[i].counts[1].store(0, std::memory_order_relaxed);
+				}
+			}
+		};
+
+		/// shared output state, function static so no .cpp storage is needed
+		static Output& output() {
+			static Output output;
+			return output;
+		}
+
+		/// counts the calling thread as using the current sink while in scope,
+		/// the sink pointer must be loaded afterwards, see setSink()
+		class Reading {
+			public:
+				Reading() : m_count(readers().counts[output().epoch.load() & 1]) {m_count.fetch_add(1);}
+				~Reading() {m_count.fetch_sub(1, std::memory_order_release);}
+			private:
+				Reading(Reading const&);              // not defined, not copyable
+				Reading& operator = (Reading const&); // not defined, not assignable
+
+				/// returns the calling thread's reader counts
+				static Readers& readers() {
+					static thread_local Readers *readers = nullptr;
+					if(!readers) {
+						Output &output = Log::output();
+						readers = &output.readers[output.threads.fetch_add(1) % LOG_SINK_READERS];
+					}
+					return *readers;
+				}
+
+				std::atomic<std::uint32_t> &m_count; ///< reader count
+		};
+
+		/// streambuf which appends to a Line
+		class Streambuf : public std::streambuf {
+			public:
+				Line *line = nullptr;
+			protected:
+				int_type overflow(int_type c) {
+					if(!traits_type::eq_int_type(c, traits_type::eof())) {
+						line->append(traits_type::to_char_type(c));
+					}
+					return traits_type::not_eof(c);
+				}
+				std::streamsize xsputn(const char *s, std::streamsize n) {
+					line->append(s, (std::size_t)n);
+					return n;
+				}
+		};
+
+		/// reusable stream to format types without a fast path, thread-local
+		/// so it's only constructed once per thread instead of once per line
+		struct Stream {
+			Streambuf buffer;
+			std::ostream stream;
+			Stream() : stream(&buffer) {}
+		};
+
+		/// previous stream target & format, restored by end() so nested
+		/// Logs in the same thread can share the stream
+		struct StreamState {
+			Line *line;
+			std::ios_base::fmtflags flags;
+			std::streamsize precision;
+			std::streamsize width;
+			char fill;
+		};
+
+		/// point the thread-local stream to this line and apply its format
+		Stream& begin() {
+			static thread_local Stream stream;
+			m_previous.line = stream.buffer.line;
+			m_previous.flags = stream.stream.flags(m_flags);
+			m_previous.precision = stream.stream.precision(m_precision);
+			m_previous.width = stream.stream.width(m_width);
+			m_previous.fill = stream.stream.fill(m_fill);
+			stream.buffer.line = &m_line;
+			return stream;
+		}
+
+		/// save this line's format and restore the previous stream state
+		void end(Stream &stream) {
+			m_flags = stream.stream.flags(m_previous.flags);
+			m_precision = stream.stream.precision(m_previous.precision);
+			m_width = stream.stream.width(m_previous.width);
+			m_fill = stream.stream.fill(m_previous.fill);
+			stream.buffer.line = m_previous.line;
+			m_plain = (m_flags == (std::ios_base::dec | std::ios_base::skipws) &&
+			           m_precision == 6 && m_width == 0 && m_fill == ' ');
+		}
+
+		/// separate a text format field from preceding text with a space
+		void separate() {
+			if(m_site) {
+				if(m_line.size()) {*this << ' ';}
+			}
+			else if(m_line.size() && m_line.data()[m_line.size() - 1] != ' ') {
+				m_line.append(' ');
+			}
+		}
+
+		/// write a value via the thread-local stream,
+		/// the result is captured as a string in binary mode
+		template <class T> Log& stream(const T &value) {
+			std::size_t start = m_line.size();
+			if(m_site) { // size is filled in after
+				char *p = m_line.reserve(1 + sizeof(std::uint32_t));
+				p[0] = (char)ARG_STRING;
+				m_line.commit(1 + sizeof(std::uint32_t));
+			}
+			Stream &stream = begin();
+			stream.stream << value;
+			end(stream);
+			if(m_site) {
+				std::uint32_t size = (std::uint32_t)(m_line.size() - start - 1 - sizeof(std::uint32_t));
+				if(size == 0) { // manipulators such as std::hex
+					m_line.truncate(start);
+				}
+				else {
+					std::memcpy(m_line.data() + start + 1, &size, sizeof(size));
+				}
+			}
+			return *this;
+		}
+
+		/// write types without a fast path
+		template <class T> Log& write(const T &value) {return stream(value);}
+
+		/// write a C string
+		Log& write(const char *value) {
+			if(!value) {return *this;}
+			if(m_site) {return encode(value, std::strlen(value));}
+			m_line.append(value, std::strlen(value));
+			return *this;
+		}
+		Log& write(char *value) {return write((const char *)value);}
+
+		/// format an integer directly into the line
+		template <class T> Log& integer(T value) {
+			if(!m_plain) {return stream(value);}
+			if(m_site) {
+				if(value < 0) {return encode(ARG_INT, (std::int64_t)value);}
+				return encode(ARG_UINT, (std::uint64_t)value);
+			}
+			format(m_line, value);
+			return *this;
+		}
+
+		/// format a float directly into the line
+		template <class T> Log& floating(T value) {
+			if(!m_plain) {return stream(value);}
+			if(m_site) {return encode(ARG_DOUBLE, (double)value);}
+			format(m_line, value);
+			return *this;
+		}
+
+		/// format an integer into a line
+		template <class T> static void format(Line &line, T value) {
+			char *p = line.reserve(24);
+			#ifdef LOG_HAVE_TO_CHARS
+				line.commit(std::to_chars(p, p + 24, value).ptr - p);
+			#else
+				if(value < 0) {
+					p[0] = '-';
+					line.commit(append(p, 1, 0 - (std::uint64_t)value));
+				}
+				else {
+					line.commit(append(p, 0, (std::uint64_t)value));
+				}
+			#endif
+		}
+
+		/// reserve size bytes for a format helper's text, which is captured
+		/// as a string in binary mode, call commitText() with the length
+		char* reserveText(std::size_t size) {
+			if(!m_site) {return m_line.reserve(size);}
+			return m_line.reserve(1 + sizeof(std::uint32_t) + size) + 1 + sizeof(std::uint32_t);
+		}
+
+		/// commit size bytes written after a call to reserveText()
+		Log& commitText(std::size_t size) {
+			if(m_site) {
+				char *p = m_line.data() + m_line.size();
+				std::uint32_t length = (std::uint32_t)size;
+				p[0] = (char)ARG_STRING;
+				std::memcpy(p + 1, &length, sizeof(length));
+				m_line.commit(1 + sizeof(length));
+			}
+			m_line.commit(size);
+			return *this;
+		}
+
+		/// format a float into a line, matches default
+		/// std::ostream output ie. %g with precision 6
+		static void format(Line &line, double value) {
+			char *p = line.reserve(32);
+			#ifdef LOG_HAVE_TO_CHARS_FLOAT
+				line.commit(std::to_chars(p, p + 32, value, std::chars_format::general, 6).ptr - p);
+			#else
+				line.commit(std::snprintf(p, 32, "%g", value));
+			#endif
+		}
+		static void format(Line &line, float value) {format(line, (double)value);}
+
+	/// \section Binary Encoding
+
+		/// binary mode argument types, each is followed by it's value
+		enum ArgType {
+			ARG_INT     = 'i', ///< int64
+			ARG_UINT    = 'u', ///< uint64
+			ARG_DOUBLE  = 'd', ///< double
+			ARG_CHAR    = 'c', ///< char
+			ARG_BOOL    = 'b', ///< char, 0 or 1
+			ARG_LITERAL = 'l', ///< uint64 literal address
+			ARG_STRING  = 's'  ///< uint32 size followed by chars
+		};
+
+		/// binary file entry types
+		enum EntryType {
+			ENTRY_SITE    = 'S', ///< uint32 id, uint32 line, uint32 size, file chars
+			ENTRY_LITERAL = 'L', ///< uint64 address, uint32 size, chars
+			ENTRY_LINE    = 'R'  ///< int8 level, uint32 site id, uint32 size, args
+		};
+
+		static constexpr const char *BINARY_MAGIC = "LOGB"; ///< file magic
+		static const int BINARY_VERSION = 1; ///< file format version
+
+		/// append a binary mode argument
+		template <class T> Log& encode(ArgType type, T value) {
+			char *p = m_line.reserve(1 + sizeof(T));
+			p[0] = (char)type;
+			std::memcpy(p + 1, &value, sizeof(T));
+			m_line.commit(1 + sizeof(T));
+			return *this;
+		}
+
+		/// append a binary mode string argument, copies the chars
+		Log& encode(const char *s, std::size_t size) {
+			std::uint32_t length = (std::uint32_t)size;
+			char *p = m_line.reserve(1 + sizeof(length) + size);
+			p[0] = (char)ARG_STRING;
+			std::memcpy(p + 1, &length, sizeof(length));
+			std::memcpy(p + 1 + sizeof(length), s, size);
+			m_line.commit(1 + sizeof(length) + size);
+			return *this;
+		}
+
+		/// returns the size of the binary argument at data, including it's
+		/// type, or 0 if it is unknown or truncated
+		static std::size_t argSize(const char *data, std::size_t size) {
+			std::size_t length = 0;
+			switch(data[0]) {
+				case ARG_INT: case ARG_UINT: case ARG_DOUBLE: case ARG_LITERAL:
+					length = 1 + 8;
+					break;
+				case ARG_CHAR: case ARG_BOOL:
+					length = 1 + 1;
+					break;
+				case ARG_STRING: {
+					if(size < 1 + sizeof(std::uint32_t)) {return 0;}
+					std::uint32_t s;
+					std::memcpy(&s, data + 1, sizeof(s));
+					length = 1 + sizeof(s) + s;
+					break;
+				}
+				default:
+					return 0;
+			}
+			return length <= size ? length : 0;
+		}
+
+		/// decode binary mode arguments to text,
+		/// literal(key) returns the string for a literal address
+		template <class F> static void decode(const char *data, std::size_t size, Line &line, F literal) {
+			while(size > 0) {
+				std::size_t length = argSize(data, size);
+				if(length == 0) {return;}
+				switch(data[0]) {
+					case ARG_INT: {
+						std::int64_t i;
+						std::memcpy(&i, data + 1, sizeof(i));
+						format(line, i);
+						break;
+					}
+					case ARG_UINT: {
+						std::uint64_t u;
+						std::memcpy(&u, data + 1, sizeof(u));
+						format(line, u);
+						break;
+					}
+					case ARG_DOUBLE: {
+						double d;
+						std::memcpy(&d, data + 1, sizeof(d));
+						format(line, d);
+						break;
+					}
+					case ARG_CHAR:
+						line.append(data[1]);
+						break;
+					case ARG_BOOL:
+						line.append(data[1] ? '1' : '0');
+						break;
+					case ARG_LITERAL: {
+						std::uint64_t key;
+						std::memcpy(&key, data + 1, sizeof(key));
+						const char *s = literal(key);
+						line.append(s, std::strlen(s));
+						break;
+					}
+					case ARG_STRING:
+						line.append(data + 1 + sizeof(std::uint32_t), length - 1 - sizeof(std::uint32_t));
+						break;
+				}
+				data += length;
+				size -= length;
+			}
+		}
+
+		/// write a value to a file in native byte order
+		template <class T> static void put(std::FILE *file, T value) {
+			std::fwrite(&value, sizeof(T), 1, file);
+		}
+
+		/// read a value from a stream in native byte order
+		template <class T> static bool get(std::istream &in, T &value) {
+			return (bool)in.read((char *)&value, sizeof(T));
+		}
+
+		/// a binary mode statement site
+		struct Site {
+			const char *file;
+			int line;
+		};
+
+		/// binary mode site registry
+		struct Sites {
+			std::mutex mutex;
+			std::vector<Site> sites;
+		};
+
+		/// shared site registry, function static so no .cpp storage is needed
+		static Sites& sites() {
+			static Sites sites;
+			return sites;
+		}
+
+		/// binary file output, site & literal entries are written once
+		/// before the first line which uses them
+		struct BinaryFile {
+			std::mutex mutex;
+			std::FILE *file = nullptr;
+			std::atomic<bool> open;
+			std::vector<bool> sites; ///< sites written so far, by id
+			std::unordered_set<std::uint64_t> literals; ///< literals written so far
+			BinaryFile() : open(false) {}
+			~BinaryFile() {close();}
+
+			/// close the file and reset written entries
+			void close() {
+				open = false;
+				if(file) {
+					std::fclose(file);
+					file = nullptr;
+				}
+				sites.clear();
+				literals.clear();
+			}
+
+			/// write a binary line, returns false if the file is not open
+			bool write(Level level, unsigned int site, const char *data, std::size_t size) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!file) {return false;}
+				if(site >= sites.size() || !sites[site]) {
+					Site s;
+					{
+						Sites &registry = Log::sites();
+						std::lock_guard<std::mutex> registryLock(registry.mutex);
+						s = registry.sites[site - 1];
+					}
+					std::uint32_t length = (std::uint32_t)std::strlen(s.file);
+					std::fputc(ENTRY_SITE, file);
+					put(file, (std::uint32_t)site);
+					put(file, (std::uint32_t)s.line);
+					put(file, length);
+					std::fwrite(s.file, 1, length, file);
+					if(site >= sites.size()) {sites.resize(site + 1, false);}
+					sites[site] = true;
+				}
+				const char *p = data;
+				std::size_t remaining = size;
+				while(remaining > 0) {
+					std::size_t length = argSize(p, remaining);
+					if(length == 0) {break;}
+					if(p[0] == ARG_LITERAL) {
+						std::uint64_t key;
+						std::memcpy(&key, p + 1, sizeof(key));
+						if(literals.insert(key).second) {
+							const char *s = (const char *)(std::uintptr_t)key;
+							std::uint32_t l = (std::uint32_t)std::strlen(s);
+							std::fputc(ENTRY_LITERAL, file);
+							put(file, key);
+							put(file, l);
+							std::fwrite(s, 1, l, file);
+						}
+					}
+					p += length;
+					remaining -= length;
+				}
+				std::fputc(ENTRY_LINE, file);
+				put(file, (std::int8_t)level);
+				put(file, (std::uint32_t)site);
+				put(file, (std::uint32_t)size);
+				std::fwrite(data, 1, size, file);
+				return true;
+			}
+		};
+
+		/// shared binary file, function static so no .cpp storage is needed
+		static BinaryFile& binaryFile() {
+			static BinaryFile file;
+			return file;
+		}
+
+		Log(Log const&);              // not defined, not copyable
+		Log& operator = (Log const&); // not defined, not assignable
+
+		Level m_level;                ///< log level
+		unsigned int m_site = 0;      ///< binary mode site id or 0 for text
+		Tag m_tag = Tag{0};           ///< tag or 0 for untagged
+		Line m_line;                  ///< temp buffer
+		Line m_fields;                ///< JSON format fields buffer
+		bool m_dedup = true;          ///< check for repeats if enabled?
+
+		/// stream format, only used after a type without a fast path or a
+		/// manipulator is written
+		bool m_plain = true; ///< is the format the default?
+		std::ios_base::fmtflags m_flags = std::ios_base::dec | std::ios_base::skipws;
+		std::streamsize m_precision = 6;
+		std::streamsize m_width = 0;
+		char m_fill = ' ';
+		StreamState m_previous; ///< stream state to restore in end()
 };
@@ -0,0 +1,265 @@
+/*==============================================================================
+
+	LogCompressedFileSink.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "Log.h"
+
+#if defined( __WIN32__ ) || defined( _WIN32 )
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+/// compressed file sink uncompressed frame size in bytes
+#ifndef LOG_COMPRESSED_FRAME_SIZE
+#define LOG_COMPRESSED_FRAME_SIZE (1024 * 1024)
+#endif
+
+/// max age of a compressed file sink frame in seconds before the async
+/// backend writes it while idle, bounds how many lines are only in memory
+#ifndef LOG_COMPRESSED_FRAME_AGE
+#define LOG_COMPRESSED_FRAME_AGE 1
+#endif
+
+/// \class LogCompressedFileSink
+/// \brief appends to a compressed file of independently readable frames
+///
+/// lines are collected into frames which are deflated as separate gzip
+/// members when full, on flush(), or when older than LOG_COMPRESSED_FRAME_AGE
+/// seconds and idle() is called, which the async backend thread does whenever
+/// it runs out of lines, so compression happens on the backend thread in
+/// async mode without idle periods producing lots of small frames
+///
+/// concatenated gzip members are a valid gzip file, so the whole file can
+/// be read with zcat, while each frame is also listed in a text index file
+/// at path.idx with one line per frame:
+///
+///     offset compressedSize firstTime lastTime lines
+///
+/// times are wall clock ns since epoch, so a time range can be read by
+/// decompressing only the overlapping frames, see read():
+///
+///     Log::setSink(std::make_shared<LogCompressedFileSink>("app.log.gz"));
+///     ...
+///     LogCompressedFileSink::read("app.log.gz", start, end, std::cout);
+///
+/// note: lines in the frame being filled are lost on a crash, requires
+///       zlib (link with -lz)
+///
+class LogCompressedFileSink : public Log::Sink {
+
+	public:
+
+		/// open file at path & the path.idx index for appending
+		/// level 1 is fastest, 9 is smallest
+		LogCompressedFileSink(const std::string &path, int level=1,
+		                      std::size_t frameSize=LOG_COMPRESSED_FRAME_SIZE) :
+			path(path), frameSize(frameSize) {
+			frame.reserve(frameSize + LOG_LINE_SIZE);
+			std::memset(&stream, 0, sizeof(stream));
+			deflating = (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, // gzip wrapper
+			                          8, Z_DEFAULT_STRATEGY) == Z_OK);
+			fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+			indexFd = ::open((path + ".idx").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+			struct stat attributes;
+			if(fd >= 0 && fstat(fd, &attributes) == 0) {
+				offset = (std::uint64_t)attributes.st_size;
+			}
+		}
+		virtual ~LogCompressedFileSink() {
+			std::lock_guard<std::mutex> lock(mutex);
+			writeFrame();
+			if(deflating) {deflateEnd(&stream);}
+			if(fd >= 0) {::close(fd);}
+			if(indexFd >= 0) {::close(indexFd);}
+		}
+
+		void write(const Log::Message &message) {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::uint64_t time = (message.time ? message.time : now());
+			if(lines == 0) {
+				firstTime = time;
+				started = std::chrono::steady_clock::now();
+			}
+			if(time > lastTime) {lastTime = time;}
+			Log::format(message, frame);
+			lines++;
+			if(frame.size() >= frameSize) {
+				writeFrame();
+			}
+		}
+
+		/// write the current frame, however small
+		void flush() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(lines > 0) {writeFrame();}
+		}
+
+		/// write the current frame if it's older than LOG_COMPRESSED_FRAME_AGE,
+		/// so idle periods don't produce lots of small frames
+		void idle() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(lines > 0 && std::chrono::steady_clock::now() - started >=
+			   std::chrono::seconds(LOG_COMPRESSED_FRAME_AGE)) {
+				writeFrame();
+			}
+		}
+
+		/// is the file open?
+		bool isOpen() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return fd >= 0 && indexFd >= 0 && deflating;
+		}
+
+		/// file path
+		const std::string& getPath() const {return path;}
+
+		/// decompress the frames of the file at path with lines between the
+		/// first & last wall clock times in ns since epoch to out, only the
+		/// overlapping frames are read, so lines just outside the range may
+		/// be included, returns false if the file or index can't be read
+		static bool read(const std::string &path, std::uint64_t first,
+		                 std::uint64_t last, std::ostream &out) {
+			std::FILE *index = std::fopen((path + ".idx").c_str(), "r");
+			if(!index) {return false;}
+			std::FILE *file = std::fopen(path.c_str(), "rb");
+			if(!file) {
+				std::fclose(index);
+				return false;
+			}
+			bool success = true;
+			unsigned long long offset, size, frameFirst, frameLast, lines;
+			std::vector<unsigned char> compressed;
+			std::vector<char> text(65536);
+			while(std::fscanf(index, "%llu %llu %llu %llu %llu",
+			                  &offset, &size, &frameFirst, &frameLast, &lines) == 5) {
+				if(frameLast < first || frameFirst > last) {continue;}
+				compressed.resize(size);
+				#if defined( __WIN32__ ) || defined( _WIN32 )
+					int seek = _fseeki64(file, (__int64)offset, SEEK_SET);
+				#else
+					int seek = fseeko(file, (off_t)offset, SEEK_SET);
+				#endif
+				if(seek != 0 ||
+				   std::fread(compressed.data(), 1, size, file) != size) {
+					success = false;
+					break;
+				}
+				z_stream inflater;
+				std::memset(&inflater, 0, sizeof(inflater));
+				if(inflateInit2(&inflater, 15 + 16) != Z_OK) {
+					success = false;
+					break;
+				}
+				inflater.next_in = compressed.data();
+				inflater.avail_in = (uInt)size;
+				int result = Z_OK;
+				while(result == Z_OK) {
+					inflater.next_out = (Bytef *)text.data();
+					inflater.avail_out = (uInt)text.size();
+					result = inflate(&inflater, Z_NO_FLUSH);
+					out.write(text.data(), text.size() - inflater.avail_out);
+				}
+				inflateEnd(&inflater);
+				if(result != Z_STREAM_END) {
+					success = false;
+					break;
+				}
+			}
+			std::fclose(file);
+			std::fclose(index);
+			return success;
+		}
+
+	protected:
+
+		/// compress the frame, write it, and add it to the index,
+		/// mutex must be locked
+		void writeFrame() {
+			if(lines == 0) {return;}
+			if(fd >= 0 && deflating) {
+				compressed.resize(deflateBound(&stream, (uLong)frame.size()));
+				stream.next_in = (Bytef *)frame.data();
+				stream.avail_in = (uInt)frame.size();
+				stream.next_out = (Bytef *)compressed.data();
+				stream.avail_out = (uInt)compressed.size();
+				if(deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+					std::size_t size = compressed.size() - stream.avail_out;
+					if(writeAll(fd, (const char *)compressed.data(), size)) {
+						char entry[128];
+						int length = std::snprintf(entry, sizeof(entry), "%llu %llu %llu %llu %llu\n",
+							(unsigned long long)offset, (unsigned long long)size,
+							(unsigned long long)firstTime, (unsigned long long)lastTime,
+							(unsigned long long)lines);
+						if(indexFd >= 0 && length > 0) {writeAll(indexFd, entry, (std::size_t)length);}
+						offset += size;
+					}
+				}
+				deflateReset(&stream); // reuse the compressor state
+			}
+			frame.clear();
+			lines = 0;
+			lastTime = 0;
+		}
+
+		/// write all bytes, returns false on error
+		static bool writeAll(int fd, const char *data, std::size_t size) {
+			while(size > 0) {
+				long written = (long)::write(fd, data, size);
+				if(written <= 0) {return false;}
+				data += written;
+				size -= (std::size_t)written;
+			}
+			return true;
+		}
+
+		/// wall clock time in ns since epoch
+		static std::uint64_t now() {
+			return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		std::string path;                 ///< file path
+		std::size_t frameSize;            ///< uncompressed frame size in bytes
+		std::string frame;                ///< lines in the current frame
+		std::vector<unsigned char> compressed; ///< compressed frame buffer
+		std::size_t lines = 0;            ///< number of lines in the frame
+		std::uint64_t firstTime = 0;      ///< first line time in the frame
+		std::uint64_t lastTime = 0;       ///< last line time in the frame
+		std::chrono::steady_clock::time_point started; ///< frame start time
+		std::uint64_t offset = 0;         ///< file size in bytes
+		z_stream stream;                  ///< gzip compressor
+		bool deflating = false;           ///< is the compressor ready?
+		int fd = -1;                      ///< file descriptor
+		int indexFd = -1;                 ///< index file descriptor
+		std::mutex mutex;                 ///< frame & file mutex
+};
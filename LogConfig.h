@@ -0,0 +1,282 @@
+/*==============================================================================
+
+	LogConfig.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include "Log.h"
+#include "LogSinks.h"
+#include "PathWatcher.h"
+
+/// \class LogConfig
+/// \brief reconfigures Log at runtime from a config file
+///
+/// the file has one setting per line with # comments, settings which are
+/// not in the file are left as they are:
+///
+///     level = verbose   # debug, verbose, normal, warn, or error
+///     output = app.log  # console, stdout, stderr, null, or a file path
+///     format = json     # text or json
+///     timestamps = true # true or false
+///     tag.net = debug   # tag level, or inherit to follow the global level
+///
+/// load() applies the file now, watch() starts a thread which reloads it
+/// when it changes, using a PathWatcher, or when the process receives
+/// SIGHUP, so the level of a running program can be raised without a
+/// restart:
+///
+///     LogConfig config("log.conf");
+///     config.load();
+///     config.watch();
+///     ...
+///     $ echo "level = verbose" > log.conf
+///
+/// levels & formats are atomics and sinks are swapped with Log::setSink(),
+/// so logging threads never wait for a reload
+///
+/// changes are detected by the file's modification time & size, in ns
+/// where the platform provides it, SIGHUP always reloads the file
+///
+/// note: the level requires LOG_STATIC_LEVEL, the output sink is only
+///       replaced when the output setting changes
+///
+class LogConfig {
+
+	public:
+
+		/// set the config file path
+		LogConfig(const std::string &path) : path(path) {}
+		virtual ~LogConfig() {unwatch();}
+
+		/// load & apply the config file, returns false if it can't be read
+		bool load() {
+			std::ifstream file(path.c_str());
+			if(!file.is_open()) {
+				LOG_WARN << "LogConfig: could not open " << path << std::endl;
+				return false;
+			}
+			std::stringstream text;
+			text << file.rdbuf();
+			parse(text.str());
+			return true;
+		}
+
+		/// parse & apply settings from config file text
+		void parse(const std::string &text) {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::istringstream lines(text);
+			std::string line;
+			int number = 0;
+			while(std::getline(lines, line)) {
+				number++;
+				std::size_t comment = line.find('#');
+				if(comment != std::string::npos) {line.erase(comment);}
+				if(trim(line).empty()) {continue;}
+				std::size_t equals = line.find('=');
+				std::string key = (equals == std::string::npos ? line : line.substr(0, equals));
+				std::string value = (equals == std::string::npos ? "" : line.substr(equals + 1));
+				if(!apply(trim(key), trim(value))) {
+					LOG_WARN << "LogConfig: ignoring " << path << ":" << number
+					         << " \"" << trim(line) << "\"" << std::endl;
+				}
+			}
+		}
+
+		/// start a thread which reloads the config file when it changes or,
+		/// if hangup is true, when the process receives SIGHUP, the file is
+		/// checked every interval ms
+		/// note: replaces any existing SIGHUP handler while watching
+		void watch(bool hangup=true, unsigned int interval=500) {
+			if(thread) {return;}
+			watcher.addPath(path);
+			if(hangup) {
+				#ifdef SIGHUP
+					hungUp().store(false);
+					previous = std::signal(SIGHUP, LogConfig::hangup);
+					handling = true;
+				#endif
+			}
+			stopping = false;
+			thread = new std::thread([this, interval] {
+				std::unique_lock<std::mutex> lock(threadMutex);
+				while(!stopping) {
+					condition.wait_for(lock, std::chrono::milliseconds(interval));
+					if(stopping) {break;}
+					bool changed = false;
+					watcher.update();
+					while(watcher.waitingEvents()) {
+						PathWatcher::ChangeType change = watcher.nextEvent().change;
+						if(change == PathWatcher::CREATED || change == PathWatcher::MODIFIED) {
+							changed = true;
+						}
+					}
+					if(hungUp().exchange(false) || changed) {
+						lock.unlock();
+						load();
+						lock.lock();
+					}
+				}
+			});
+		}
+
+		/// stop watching & restore the previous SIGHUP handler
+		void unwatch() {
+			if(!thread) {return;}
+			{
+				std::lock_guard<std::mutex> lock(threadMutex);
+				stopping = true;
+			}
+			condition.notify_one();
+			thread->join();
+			delete thread;
+			thread = nullptr;
+			watcher.removePath(path);
+			#ifdef SIGHUP
+				if(handling) {
+					std::signal(SIGHUP, previous);
+					handling = false;
+				}
+			#endif
+		}
+
+		/// is the watch thread running?
+		bool isWatching() {return thread != nullptr;}
+
+		/// config file path
+		const std::string& getPath() const {return path;}
+
+		/// parse a level name, returns false if it's unknown
+		static bool parseLevel(const std::string &name, Log::Level &level) {
+			static const char *names[] = {"debug", "verbose", "normal", "warn", "error"};
+			for(int i = 0; i < 5; ++i) {
+				if(name == names[i]) {
+					level = (Log::Level)(Log::LEVEL_DEBUG + i);
+					return true;
+				}
+			}
+			return false;
+		}
+
+	protected:
+
+		LogConfig(LogConfig const&);              // not defined, not copyable
+		LogConfig& operator = (LogConfig const&); // not defined, not assignable
+
+		/// apply a setting, returns false if it's unknown or invalid,
+		/// mutex must be locked
+		bool apply(const std::string &key, const std::string &value) {
+			Log::Level level;
+			if(key == "level") {
+				if(!parseLevel(value, level)) {return false;}
+				#ifdef LOG_STATIC_LEVEL
+					Log::logLevel = level;
+					return true;
+				#else
+					return false; // fixed at compile time
+				#endif
+			}
+			else if(key == "output") {
+				if(value.empty()) {return false;}
+				if(value != output) {
+					output = value;
+					Log::setSink(sink(value));
+				}
+				return true;
+			}
+			else if(key == "format") {
+				if(value == "text") {Log::setFormat(Log::FORMAT_TEXT);}
+				else if(value == "json") {Log::setFormat(Log::FORMAT_JSON);}
+				else {return false;}
+				return true;
+			}
+			else if(key == "timestamps") {
+				if(value == "true") {Log::setTimestamps(true);}
+				else if(value == "false") {Log::setTimestamps(false);}
+				else {return false;}
+				return true;
+			}
+			else if(key.compare(0, 4, "tag.") == 0 && key.size() > 4) {
+				if(value == "inherit") {
+					Log::resetTagLevel(key.substr(4));
+					return true;
+				}
+				if(!parseLevel(value, level)) {return false;}
+				Log::setTagLevel(key.substr(4), level);
+				return true;
+			}
+			return false;
+		}
+
+		/// create the sink for an output setting
+		static std::shared_ptr<Log::Sink> sink(const std::string &output) {
+			if(output == "null") {return std::make_shared<LogNullSink>();}
+			if(output == "console" || output == "stdout" || output == "stderr") {
+				std::shared_ptr<LogConsoleSink> console = std::make_shared<LogConsoleSink>();
+				if(output == "stdout") {console->setFd(1);}
+				else if(output == "stderr") {console->setFd(2);}
+				return console;
+			}
+			std::shared_ptr<LogFileSink> file = std::make_shared<LogFileSink>(output);
+			if(!file->isOpen()) {
+				LOG_ERROR << "LogConfig: could not open output " << output << std::endl;
+			}
+			return file;
+		}
+
+		/// returns a string without leading & trailing whitespace
+		static std::string trim(const std::string &s) {
+			std::size_t start = s.find_first_not_of(" \t\r\n");
+			if(start == std::string::npos) {return "";}
+			std::size_t end = s.find_last_not_of(" \t\r\n");
+			return s.substr(start, end - start + 1);
+		}
+
+		/// SIGHUP received flag, function static so no .cpp storage is needed
+		static std::atomic<bool>& hungUp() {
+			static std::atomic<bool> hungUp(false);
+			return hungUp;
+		}
+
+		/// SIGHUP handler, the reload happens on the watch thread
+		static void hangup(int signal) {
+			(void)signal;
+			hungUp().store(true);
+		}
+
+		std::string path;                ///< config file path
+		std::string output;              ///< current output setting
+		std::mutex mutex;                ///< settings mutex
+		PathWatcher watcher;             ///< config file watcher
+		std::thread *thread = nullptr;   ///< watch thread
+		bool stopping = false;           ///< stop the watch thread?
+		std::mutex threadMutex;          ///< watch thread mutex
+		std::condition_variable condition; ///< wakes the watch thread
+		void (*previous)(int) = SIG_DFL; ///< previous SIGHUP handler
+		bool handling = false;           ///< is the SIGHUP handler installed?
+};
@@ -0,0 +1,227 @@
+/*==============================================================================
+
+	LogMappedFileSink.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Log.h"
+
+/// mapped file sink chunk size in bytes, rounded to the page size
+#ifndef LOG_MAPPED_CHUNK_SIZE
+#define LOG_MAPPED_CHUNK_SIZE (64 * 1024 * 1024)
+#endif
+
+/// \class LogMappedFileSink
+/// \brief appends to a memory-mapped file without locks or syscalls
+///
+/// the file is grown and mapped in preallocated chunks, writers reserve space
+/// in the current chunk with an atomic cursor and copy their line directly
+/// into the mapping, the kernel writes the pages out in the background
+///
+/// since the pages belong to the kernel page cache, everything copied so far
+/// is still in the file if the process crashes, call flush() to schedule
+/// writeback if you also want to survive power loss
+///
+/// only the thread which fills up a chunk takes a lock to map the next one,
+/// the unused end of each full chunk is left NUL filled and the file is
+/// truncated to the last line on close, or when it's opened again after a
+/// crash:
+///
+///     Log::setSink(std::make_shared<LogMappedFileSink>("app.log"));
+///
+/// note: POSIX only
+///
+class LogMappedFileSink : public Log::Sink {
+
+	public:
+
+		/// open file at path, appends to an existing file unless append is false
+		LogMappedFileSink(const std::string &path, bool append=true,
+		                  std::size_t chunkSize=LOG_MAPPED_CHUNK_SIZE) : path(path) {
+			long page = sysconf(_SC_PAGESIZE);
+			pageSize = (page > 0 ? (std::size_t)page : 4096);
+			this->chunkSize = ((chunkSize + pageSize - 1) / pageSize) * pageSize;
+			if(this->chunkSize == 0) {this->chunkSize = pageSize;}
+			fd = ::open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+			if(fd < 0) {return;}
+			struct stat attributes;
+			std::size_t size = (fstat(fd, &attributes) == 0 ? (std::size_t)attributes.st_size : 0);
+			if(size > 0) { // drop the NUL padding left if the process crashed
+				size = contentEnd(size);
+				int result = ftruncate(fd, (off_t)size);
+				(void)result;
+			}
+			std::size_t offset = size & ~(pageSize - 1); // mmap offsets are page aligned
+			std::lock_guard<std::mutex> lock(mutex);
+			map(offset);
+			Chunk *chunk = current.load();
+			if(chunk) {chunk->cursor = size - offset;} // append after the existing end
+		}
+
+		/// unmaps and truncates the file to the end of the last line
+		virtual ~LogMappedFileSink() {
+			std::lock_guard<std::mutex> lock(mutex);
+			Chunk *chunk = current.load();
+			std::size_t end = 0;
+			if(chunk) {
+				std::size_t used = chunk->cursor.load();
+				end = chunk->offset + (used < chunk->size ? used : chunk->size);
+			}
+			for(std::size_t i = 0; i < chunks.size(); ++i) {
+				unmap(chunks[i]);
+				delete chunks[i];
+			}
+			if(fd >= 0) {
+				if(chunk) {
+					int result = ftruncate(fd, (off_t)end); // keeps NUL padding on error
+					(void)result;
+				}
+				::close(fd);
+			}
+		}
+
+		void write(const Log::Message &message) {
+			Log::Line line;
+			Log::format(message, line);
+			std::size_t size = line.size();
+			if(size > chunkSize) {size = chunkSize;} // truncate huge lines
+			while(true) {
+				Chunk *chunk = current.load(std::memory_order_acquire);
+				if(!chunk) {return;} // not open
+				chunk->writers++;
+				std::size_t pos = chunk->cursor.fetch_add(size);
+				if(pos + size <= chunk->size) {
+					std::memcpy(chunk->data + pos, line.data(), size);
+					chunk->writers--;
+					return;
+				}
+				chunk->writers--;
+				next(chunk);
+			}
+		}
+
+		/// schedule writeback of the mapped pages to disk
+		void flush() {
+			std::lock_guard<std::mutex> lock(mutex);
+			Chunk *chunk = current.load();
+			if(chunk && chunk->data) {
+				msync(chunk->data, chunk->size, MS_ASYNC);
+			}
+		}
+
+		/// is the file open and mapped?
+		bool isOpen() {return current.load() != nullptr;}
+
+		/// file path
+		const std::string& getPath() const {return path;}
+
+	protected:
+
+		/// a mapped region of the file
+		struct Chunk {
+			char *data = nullptr;          ///< mapped memory
+			std::size_t size = 0;          ///< mapped size in bytes
+			std::size_t offset = 0;        ///< file offset in bytes
+			std::atomic<std::size_t> cursor; ///< next write position
+			std::atomic<int> writers;      ///< number of threads copying
+			Chunk() : cursor(0), writers(0) {}
+		};
+
+		/// map the next chunk if chunk is still current
+		void next(Chunk *chunk) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(current.load() != chunk) {return;} // another thread got here first
+			map(chunk->offset + chunk->size);
+			// late writers only see a full cursor, so chunks without
+			// writers can be unmapped, their structs are kept until close
+			for(std::size_t i = 0; i < chunks.size(); ++i) {
+				if(chunks[i] != current.load() && chunks[i]->writers.load() == 0) {
+					unmap(chunks[i]);
+				}
+			}
+		}
+
+		/// grow the file and map a new chunk at offset, mutex must be locked
+		void map(std::size_t offset) {
+			int error = -1;
+			#ifdef __linux__
+				// reserve blocks so writing to the mapping can't fail with SIGBUS
+				error = posix_fallocate(fd, (off_t)offset, (off_t)chunkSize);
+			#endif
+			if(error != 0 && error != ENOSPC) { // not supported, grow sparse
+				error = ftruncate(fd, (off_t)(offset + chunkSize));
+			}
+			if(error != 0) {
+				current = nullptr;
+				return;
+			}
+			void *data = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)offset);
+			if(data == MAP_FAILED) {
+				current = nullptr;
+				return;
+			}
+			Chunk *chunk = new Chunk;
+			chunk->data = (char *)data;
+			chunk->size = chunkSize;
+			chunk->offset = offset;
+			chunks.push_back(chunk);
+			current.store(chunk, std::memory_order_release);
+		}
+
+		/// returns the file size without trailing NUL bytes, which are the
+		/// unused end of the last chunk when the file wasn't truncated on close
+		std::size_t contentEnd(std::size_t size) {
+			std::vector<char> buffer(65536);
+			while(size > 0) {
+				std::size_t count = (size < buffer.size() ? size : buffer.size());
+				ssize_t read = pread(fd, buffer.data(), count, (off_t)(size - count));
+				if(read != (ssize_t)count) {break;} // keep the rest on error
+				std::size_t end = count;
+				while(end > 0 && buffer[end - 1] == '\0') {end--;}
+				if(end > 0) {return size - count + end;}
+				size -= count;
+			}
+			return size;
+		}
+
+		/// unmap a chunk's memory
+		void unmap(Chunk *chunk) {
+			if(chunk->data) {
+				munmap(chunk->data, chunk->size);
+				chunk->data = nullptr;
+			}
+		}
+
+		std::string path;            ///< file path
+		int fd = -1;                 ///< file descriptor
+		std::size_t pageSize;        ///< system page size
+		std::size_t chunkSize;       ///< chunk size in bytes
+		std::atomic<Chunk*> current{nullptr}; ///< chunk being written to
+		std::vector<Chunk*> chunks;  ///< all chunks, kept until close
+		std::mutex mutex;            ///< chunk mapping mutex
+};
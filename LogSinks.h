@@ -0,0 +1,677 @@
+/*==============================================================================
+
+	LogSinks.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "Log.h"
+
+#ifdef LOG_USE_ZLIB
+	#include <zlib.h>
+#endif
+
+#if defined( __WIN32__ ) || defined( _WIN32 )
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+/// file sink batch buffer size in bytes
+#ifndef LOG_FILE_BUFFER_SIZE
+#define LOG_FILE_BUFFER_SIZE 65536
+#endif
+
+/// console sink max pending size in bytes before lines are written
+#ifndef LOG_CONSOLE_BUFFER_SIZE
+#define LOG_CONSOLE_BUFFER_SIZE 16384
+#endif
+
+/// console sink max write() size in bytes, PIPE_BUF by default as writes up
+/// to that size are atomic on pipes
+#ifndef LOG_CONSOLE_WRITE_SIZE
+	#ifdef PIPE_BUF
+		#define LOG_CONSOLE_WRITE_SIZE PIPE_BUF
+	#else
+		#define LOG_CONSOLE_WRITE_SIZE 4096
+	#endif
+#endif
+
+/// max time in ms the console sink holds lines before writing them
+#ifndef LOG_CONSOLE_INTERVAL
+#define LOG_CONSOLE_INTERVAL 50
+#endif
+
+/// \class LogConsoleSink
+/// \brief prints to the console: debug, verbose & normal to stdout,
+///        warn & error to stderr
+///
+/// lines are written directly to the file descriptors, each complete line
+/// with a single write() so lines from different threads never interleave,
+/// and there is no per-line flush
+///
+/// bursts of lines are coalesced into writes of whole lines up to
+/// LOG_CONSOLE_WRITE_SIZE bytes, PIPE_BUF by default, so lines up to that
+/// size also don't interleave with other processes writing to the same
+/// pipe: lines are held until bufferSize bytes are pending, a warn or error
+/// line is written, flush() is called, or at most interval ms, after which
+/// a background thread writes them, set interval to 0 to write every line
+/// immediately
+///
+/// lines logged while another thread is writing are written together by
+/// that thread as soon as it's done, the order of lines is kept across
+/// stdout & stderr
+///
+/// all lines can also be sent to one of them, see setFd()
+///
+/// note: flush std::cout & std::cerr before logging if the program also
+///       prints through them, as their buffers are separate
+///
+class LogConsoleSink : public Log::Sink {
+
+	public:
+
+		/// coalesce up to bufferSize bytes per write, holding lines for at
+		/// most interval ms
+		LogConsoleSink(std::size_t bufferSize=LOG_CONSOLE_BUFFER_SIZE,
+		               unsigned int interval=LOG_CONSOLE_INTERVAL) :
+			bufferSize(bufferSize), interval(interval) {
+			pending.reserve(bufferSize + LOG_LINE_SIZE);
+			writing.reserve(bufferSize + LOG_LINE_SIZE);
+		}
+		virtual ~LogConsoleSink() {
+			if(flusher) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				flusherCondition.notify_one();
+				flusher->join();
+				delete flusher;
+			}
+			flush();
+		}
+
+		void write(const Log::Message &message) {
+			Log::Line line;
+			Log::format(message, line);
+			std::unique_lock<std::mutex> lock(mutex);
+			bool first = pending.empty();
+			append(fd ? fd : (message.level >= Log::LEVEL_WARN ? 2 : 1), line.data(), line.size());
+			if(busy) {return;} // the writing thread picks it up
+			if(interval > 0 && message.level < Log::LEVEL_WARN && pending.size() < bufferSize) {
+				if(first) { // start the wait for the flusher
+					if(!flusher) {flusher = new std::thread(&LogConsoleSink::flushLoop, this);}
+					else {flusherCondition.notify_one();}
+				}
+				return;
+			}
+			writePending(lock);
+		}
+
+		void flush() {
+			std::unique_lock<std::mutex> lock(mutex);
+			if(!busy) {writePending(lock);}
+		}
+
+		/// write pending lines without locking from a fatal signal handler
+		void crashed() {
+			writeRuns(pending, pendingRuns);
+		}
+
+		/// lines written from a fatal signal handler go to the console too
+		int safeFd(Log::Level level) {
+			return fd ? fd : (level >= Log::LEVEL_WARN ? 2 : 1);
+		}
+
+		/// write all lines to a file descriptor, ie. 1 for stdout or 2 for
+		/// stderr, or 0 to split by level (default)
+		void setFd(int fd) {
+			std::lock_guard<std::mutex> lock(mutex);
+			this->fd = fd;
+		}
+
+		/// returns the file descriptor all lines are written to, or 0 if
+		/// split by level
+		int getFd() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return fd;
+		}
+
+	protected:
+
+		/// a run of consecutive bytes for the same file descriptor
+		struct Run {
+			int fd;
+			std::size_t end; ///< end offset in the buffer
+		};
+
+		/// append a line to the pending buffer, extending the last run if
+		/// it's for the same file descriptor, mutex must be locked
+		void append(int fd, const char *data, std::size_t size) {
+			pending.append(data, size);
+			if(pendingRuns.empty() || pendingRuns.back().fd != fd) {
+				pendingRuns.push_back(Run{fd, pending.size()});
+			}
+			else {
+				pendingRuns.back().end = pending.size();
+			}
+		}
+
+		/// write the pending lines until none are left, lines added by other
+		/// threads meanwhile are written in the next round, mutex must be
+		/// locked and is unlocked while writing
+		void writePending(std::unique_lock<std::mutex> &lock) {
+			busy = true;
+			while(!pending.empty()) {
+				pending.swap(writing);
+				pendingRuns.swap(writingRuns);
+				lock.unlock();
+				writeRuns(writing, writingRuns);
+				writing.clear();
+				writingRuns.clear();
+				lock.lock();
+			}
+			busy = false;
+		}
+
+		/// write a buffer's runs, each with as few writes of whole lines up to
+		/// LOG_CONSOLE_WRITE_SIZE bytes as possible, longer lines are written
+		/// on their own
+		static void writeRuns(const std::string &buffer, const std::vector<Run> &runs) {
+			std::size_t start = 0;
+			for(std::size_t i = 0; i < runs.size(); ++i) {
+				while(start < runs[i].end) {
+					std::size_t end = runs[i].end;
+					if(end - start > LOG_CONSOLE_WRITE_SIZE) {
+						std::size_t newline = buffer.rfind('\n', start + LOG_CONSOLE_WRITE_SIZE - 1);
+						if(newline == std::string::npos || newline < start) {
+							newline = buffer.find('\n', start); // a long line
+						}
+						if(newline != std::string::npos && newline < end) {end = newline + 1;}
+					}
+					const char *p = buffer.data() + start;
+					std::size_t remaining = end - start;
+					while(remaining > 0) {
+						long written = (long)::write(runs[i].fd, p, remaining);
+						if(written < 0 && errno == EINTR) {continue;}
+						if(written <= 0) {break;} // drop on error
+						p += written;
+						remaining -= written;
+					}
+					start = end;
+				}
+			}
+		}
+
+		/// flusher thread: waits for pending lines, then writes them after
+		/// the interval unless they were written already
+		void flushLoop() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while(!stopping) {
+				if(pending.empty() || busy) {
+					flusherCondition.wait(lock);
+					continue;
+				}
+				flusherCondition.wait_for(lock, std::chrono::milliseconds(interval));
+				if(!busy) {writePending(lock);}
+			}
+		}
+
+		std::size_t bufferSize;          ///< max pending size in bytes
+		unsigned int interval;           ///< max pending time in ms
+		std::string pending;             ///< lines waiting to be written
+		std::vector<Run> pendingRuns;    ///< pending file descriptor runs
+		std::string writing;             ///< lines being written
+		std::vector<Run> writingRuns;    ///< writing file descriptor runs
+		int fd = 0;                      ///< file descriptor or 0 to split
+		bool busy = false;               ///< is a thread writing?
+		bool stopping = false;           ///< stop the flusher thread?
+		std::thread *flusher = nullptr;  ///< flusher thread, started as needed
+		std::condition_variable flusherCondition; ///< wakes the flusher
+		std::mutex mutex;                ///< buffer & flusher state mutex
+};
+
+/// \class LogNullSink
+/// \brief discards everything
+class LogNullSink : public Log::Sink {
+	public:
+		void write(const Log::Message &message) {(void)message;}
+};
+
+/// \class LogMemorySink
+/// \brief keeps the most recent formatted lines in memory
+///
+/// useful for tests or showing recent output in a UI:
+///
+///     std::shared_ptr<LogMemorySink> memory = std::make_shared<LogMemorySink>(100);
+///     Log::setSink(memory);
+///     ...
+///     for(const std::string &line : memory->lines()) {
+///         ...
+///     }
+///
+class LogMemorySink : public Log::Sink {
+
+	public:
+
+		/// keep up to capacity lines, 0 for unlimited
+		LogMemorySink(std::size_t capacity=1000) : capacity(capacity) {}
+
+		void write(const Log::Message &message) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(capacity > 0 && buffer.size() >= capacity) {
+				buffer.pop_front();
+			}
+			buffer.push_back(std::string());
+			Log::format(message, buffer.back());
+		}
+
+		/// returns a copy of the current lines, oldest first
+		std::vector<std::string> lines() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return std::vector<std::string>(buffer.begin(), buffer.end());
+		}
+
+		/// remove all lines
+		void clear() {
+			std::lock_guard<std::mutex> lock(mutex);
+			buffer.clear();
+		}
+
+	protected:
+
+		std::size_t capacity;            ///< max number of lines
+		std::deque<std::string> buffer;  ///< lines, oldest first
+		std::mutex mutex;                ///< buffer mutex
+};
+
+/// \class LogFileSink
+/// \brief appends to a file, batching lines into large writes
+///
+/// lines are collected in a buffer which is written with a single write()
+/// when full, when a line at or above the flush level is written, or when
+/// flush() is called, which the async backend thread does whenever it runs
+/// out of lines
+///
+/// note: call Log::flush() periodically when not using async mode,
+///       otherwise lower level lines may wait in the buffer
+///
+class LogFileSink : public Log::Sink {
+
+	public:
+
+		/// open file at path for appending, lines at or above flushLevel are
+		/// written out immediately
+		LogFileSink(const std::string &path, Log::Level flushLevel=Log::LEVEL_WARN,
+		            std::size_t bufferSize=LOG_FILE_BUFFER_SIZE) :
+			path(path), flushLevel(flushLevel), bufferSize(bufferSize) {
+			buffer.reserve(bufferSize * 2);
+			openFile();
+		}
+		virtual ~LogFileSink() {
+			flush();
+			closeFile();
+		}
+
+		void write(const Log::Message &message) {
+			std::lock_guard<std::mutex> lock(mutex);
+			willWrite();
+			Log::format(message, buffer);
+			if(full() || message.level >= flushLevel) {
+				writeBuffer();
+			}
+		}
+
+		void flush() {
+			std::lock_guard<std::mutex> lock(mutex);
+			writeBuffer();
+		}
+
+		/// write the buffer without locking from a fatal signal handler
+		void crashed() {
+			if(fd < 0) {return;}
+			const char *p = buffer.data();
+			std::size_t remaining = buffer.size();
+			while(remaining > 0) {
+				long written = (long)::write(fd, p, remaining);
+				if(written <= 0) {break;}
+				p += written;
+				remaining -= written;
+			}
+		}
+
+		/// lines written from a fatal signal handler go to the file too
+		int safeFd(Log::Level level) {
+			(void)level;
+			return fd;
+		}
+
+		/// is the file open?
+		bool isOpen() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return fd >= 0;
+		}
+
+		/// file path
+		const std::string& getPath() const {return path;}
+
+	protected:
+
+		/// open the file for appending, returns false on error
+		bool openFile() {
+			fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+			if(fd < 0) {return false;}
+			struct stat attributes;
+			fileSize = (fstat(fd, &attributes) == 0 ? (std::size_t)attributes.st_size : 0);
+			return true;
+		}
+
+		/// close the file
+		void closeFile() {
+			if(fd >= 0) {
+				::close(fd);
+				fd = -1;
+			}
+		}
+
+		/// write the buffer to the file, mutex must be locked
+		void writeBuffer() {
+			if(buffer.empty()) {return;}
+			if(fd >= 0) {
+				const char *p = buffer.data();
+				std::size_t remaining = buffer.size();
+				while(remaining > 0) {
+					long written = (long)::write(fd, p, remaining);
+					if(written <= 0) {break;} // drop on error
+					p += written;
+					remaining -= written;
+				}
+				fileSize += buffer.size() - remaining;
+			}
+			buffer.clear();
+			wroteBuffer();
+		}
+
+		/// returns true if the buffer should be written, mutex must be locked
+		virtual bool full() {return buffer.size() >= bufferSize;}
+
+		/// called before a line is added to the buffer with the mutex locked
+		virtual void willWrite() {}
+
+		/// called after the buffer is written with the mutex locked,
+		/// override to do something with the file ie. rotation
+		virtual void wroteBuffer() {}
+
+		std::string path;       ///< file path
+		Log::Level flushLevel;  ///< write out immediately at or above level
+		std::size_t bufferSize; ///< batch size in bytes
+		std::string buffer;     ///< batch buffer
+		std::size_t fileSize = 0; ///< current file size in bytes
+		int fd = -1;            ///< file descriptor
+		std::mutex mutex;       ///< buffer & file mutex
+};
+
+/// \class LogRotatingFileSink
+/// \brief appends to a file which is rotated by size and/or time
+///
+/// the current file is path, older files are path.1, path.2, etc up to
+/// maxFiles with the oldest removed
+///
+/// new files are preallocated to maxSize on Linux to avoid fragmentation and
+/// block allocation during writes
+///
+/// when built with LOG_USE_ZLIB (link with -lz), old files can be compressed
+/// to path.1.gz, path.2.gz, etc by a background thread, so writers are only
+/// blocked for the renames:
+///
+///     auto sink = std::make_shared<LogRotatingFileSink>("app.log", 64 * 1024 * 1024, 10);
+///     sink->setInterval(24 * 60 * 60); // also rotate daily
+///     sink->setCompress(true);
+///     Log::setSink(sink);
+///
+class LogRotatingFileSink : public LogFileSink {
+
+	public:
+
+		/// rotate path when larger than maxSize bytes, keeping maxFiles old
+		/// files, set maxSize to 0 to only rotate by time
+		/// note: the buffer size is limited to maxSize
+		LogRotatingFileSink(const std::string &path, std::size_t maxSize,
+		                    unsigned int maxFiles=5,
+		                    Log::Level flushLevel=Log::LEVEL_WARN,
+		                    std::size_t bufferSize=LOG_FILE_BUFFER_SIZE) :
+			LogFileSink(path, flushLevel,
+			            (maxSize == 0 || bufferSize < maxSize) ? bufferSize : maxSize),
+			maxSize(maxSize), maxFiles(maxFiles) {
+			opened = std::chrono::steady_clock::now();
+			preallocate();
+		}
+		virtual ~LogRotatingFileSink() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				writeBuffer();
+				release();
+			}
+			if(compressor) {
+				{
+					std::lock_guard<std::mutex> lock(pendingMutex);
+					stopping = true;
+				}
+				pendingCondition.notify_one();
+				compressor->join();
+				delete compressor;
+			}
+		}
+
+		/// also rotate when the file is older than seconds, 0 disables
+		void setInterval(unsigned int seconds) {
+			std::lock_guard<std::mutex> lock(mutex);
+			interval = seconds;
+		}
+
+		/// preallocate new files to maxSize? (default: true)
+		/// note: only on Linux
+		void setPreallocate(bool preallocate) {
+			std::lock_guard<std::mutex> lock(mutex);
+			this->preallocating = preallocate;
+		}
+
+		/// compress old files in a background thread? (default: false)
+		/// note: requires LOG_USE_ZLIB, otherwise ignored
+		void setCompress(bool compress) {
+			std::lock_guard<std::mutex> lock(mutex);
+			#ifdef LOG_USE_ZLIB
+				compressing = compress;
+			#else
+				(void)compress;
+			#endif
+		}
+
+	protected:
+
+		/// write out before the file would grow past maxSize
+		bool full() {
+			return LogFileSink::full() ||
+			       (maxSize > 0 && fileSize + buffer.size() >= maxSize);
+		}
+
+		/// rotate before writing to a file which is too old
+		void willWrite() {
+			if(expired() && fileSize + buffer.size() > 0) {
+				writeBuffer();
+				if(expired()) {rotate();}
+			}
+		}
+
+		/// rotate when the file is too big or too old
+		void wroteBuffer() {
+			if((maxSize > 0 && fileSize >= maxSize) || (fileSize > 0 && expired())) {
+				rotate();
+			}
+		}
+
+		/// returns true if the file is older than the interval
+		bool expired() {
+			return interval > 0 &&
+			       std::chrono::steady_clock::now() - opened >= std::chrono::seconds(interval);
+		}
+
+		/// start a new file, the old file is shifted or handed to the
+		/// compressor thread
+		void rotate() {
+			release();
+			closeFile();
+			if(maxFiles == 0) {
+				std::remove(path.c_str());
+			}
+			else if(compressing) {
+				std::string pending = path + ".pending." + std::to_string(++pendingCount);
+				std::rename(path.c_str(), pending.c_str());
+				{
+					std::lock_guard<std::mutex> lock(pendingMutex);
+					pendingFiles.push_back(pending);
+				}
+				if(!compressor) {
+					compressor = new std::thread([this] {compress();});
+				}
+				pendingCondition.notify_one();
+			}
+			else {
+				shift(path, "");
+			}
+			openFile();
+			opened = std::chrono::steady_clock::now();
+			preallocate();
+		}
+
+		/// shift old files with suffix up by one and move file to number 1,
+		/// mutex must be locked
+		void shift(const std::string &file, const std::string &suffix) {
+			std::remove((numbered(maxFiles) + suffix).c_str());
+			for(unsigned int i = maxFiles; i > 1; --i) {
+				std::rename((numbered(i - 1) + suffix).c_str(), (numbered(i) + suffix).c_str());
+			}
+			std::rename(file.c_str(), (numbered(1) + suffix).c_str());
+		}
+
+		/// reserve disk space for the current file without changing it's size,
+		/// mutex must be locked
+		void preallocate() {
+			#ifdef __linux__
+				if(preallocating && fd >= 0 && maxSize > fileSize) {
+					fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)maxSize);
+				}
+			#endif
+		}
+
+		/// free space preallocated past the end of the current file, ie.
+		/// when it's closed early by a time rotation, mutex must be locked
+		void release() {
+			#ifdef __linux__
+				if(fd >= 0) {
+					int result = ftruncate(fd, (off_t)fileSize);
+					(void)result;
+				}
+			#endif
+		}
+
+		/// compressor thread loop, compresses pending files in order
+		void compress() {
+			while(true) {
+				std::string pending;
+				{
+					std::unique_lock<std::mutex> lock(pendingMutex);
+					pendingCondition.wait(lock, [this] {
+						return stopping || !pendingFiles.empty();
+					});
+					if(pendingFiles.empty()) {return;} // stopping
+					pending = pendingFiles.front();
+					pendingFiles.pop_front();
+				}
+				std::string compressed = pending + ".gz";
+				if(gzip(pending, compressed)) {
+					std::remove(pending.c_str());
+					std::lock_guard<std::mutex> lock(mutex);
+					shift(compressed, ".gz");
+				}
+				// leave the pending file on error
+			}
+		}
+
+		/// gzip a file, returns true on success
+		static bool gzip(const std::string &source, const std::string &destination) {
+			#ifdef LOG_USE_ZLIB
+				std::FILE *in = std::fopen(source.c_str(), "rb");
+				if(!in) {return false;}
+				gzFile out = gzopen(destination.c_str(), "wb1"); // fastest
+				if(!out) {
+					std::fclose(in);
+					return false;
+				}
+				std::vector<char> buffer(LOG_FILE_BUFFER_SIZE);
+				bool success = true;
+				std::size_t read;
+				while((read = std::fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+					if(gzwrite(out, buffer.data(), (unsigned int)read) != (int)read) {
+						success = false;
+						break;
+					}
+				}
+				std::fclose(in);
+				if(gzclose(out) != Z_OK) {success = false;}
+				if(!success) {std::remove(destination.c_str());}
+				return success;
+			#else
+				(void)source;
+				(void)destination;
+				return false;
+			#endif
+		}
+
+		/// returns path with a number suffix ie. "app.log.1"
+		std::string numbered(unsigned int number) {
+			return path + "." + std::to_string(number);
+		}
+
+		std::size_t maxSize;         ///< max file size in bytes, 0 for none
+		unsigned int maxFiles;       ///< number of old files to keep
+		unsigned int interval = 0;   ///< max file age in seconds, 0 for none
+		bool preallocating = true;   ///< preallocate new files?
+		bool compressing = false;    ///< compress old files?
+		std::chrono::steady_clock::time_point opened; ///< current file open time
+
+		std::thread *compressor = nullptr;   ///< compressor thread
+		std::deque<std::string> pendingFiles; ///< files waiting to be compressed
+		unsigned int pendingCount = 0;       ///< pending file name counter
+		bool stopping = false;               ///< stop the compressor thread?
+		std::mutex pendingMutex;             ///< pending file queue mutex
+		std::condition_variable pendingCondition; ///< pending file signal
+};
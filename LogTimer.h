@@ -0,0 +1,310 @@
+/*==============================================================================
+
+	LogTimer.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "Log.h"
+
+#define LOG_TIMER_CONCAT_(a, b) a##b
+#define LOG_TIMER_CONCAT(a, b) LOG_TIMER_CONCAT_(a, b)
+
+/// timer series for the calling statement, registered once
+#define LOG_TIMER_SERIES(name) []() -> LogTimer::Series& { \
+	static LogTimer::Series &series = LogTimer::series(name); \
+	return series; \
+}()
+
+/// time the enclosing scope and record it in the named series
+#define LOG_TIMER(name) \
+	LogTimer LOG_TIMER_CONCAT(log_timer_, __LINE__)(LOG_TIMER_SERIES(name))
+
+/// default timer summary interval in seconds, see LogTimer::setInterval()
+#ifndef LOG_TIMER_INTERVAL
+#define LOG_TIMER_INTERVAL 10
+#endif
+
+/// \class LogHistogram
+/// \brief fixed-size log-linear latency histogram in ns
+///
+/// values are bucketed by their highest set bit with 32 linear sub-buckets
+/// each, so the relative error is at most ~3% from 1 ns up to ~18 minutes,
+/// larger values are clamped
+///
+/// only one thread records, other threads can read the counts at any time
+/// as each count is a relaxed atomic updated without read-modify-write
+class LogHistogram {
+
+	public:
+
+		static const int SUB_BITS = 5; ///< linear sub-bucket bits
+		static const int SUB_COUNT = 1 << SUB_BITS;
+		static const int MAX_BITS = 40; ///< largest value is 2^40-1 ns
+		static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+		LogHistogram() {
+			for(int i = 0; i < BUCKETS; ++i) {
+				counts[i].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		/// record a value, only call from the owning thread
+		void record(std::uint64_t value) {
+			std::atomic<std::uint64_t> &c = counts[index(value)];
+			c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+			if(value > max.load(std::memory_order_relaxed)) {
+				max.store(value, std::memory_order_relaxed);
+			}
+		}
+
+		/// returns the bucket index for a value
+		static int index(std::uint64_t value) {
+			if(value < (std::uint64_t)SUB_COUNT) {return (int)value;}
+			if(value >> MAX_BITS) {value = (1ULL << MAX_BITS) - 1;}
+			int bit = highestBit(value);
+			int sub = (int)(value >> (bit - SUB_BITS)) & (SUB_COUNT - 1);
+			return (bit - SUB_BITS + 1) * SUB_COUNT + sub;
+		}
+
+		/// returns the middle value of a bucket
+		static std::uint64_t value(int index) {
+			if(index < SUB_COUNT) {return (std::uint64_t)index;}
+			int shift = index / SUB_COUNT - 1;
+			std::uint64_t low = (std::uint64_t)(SUB_COUNT + index % SUB_COUNT) << shift;
+			return low + ((1ULL << shift) >> 1);
+		}
+
+		std::atomic<std::uint64_t> counts[BUCKETS]; ///< per-bucket counts
+		std::atomic<std::uint64_t> sum{0};          ///< sum of all values
+		std::atomic<std::uint64_t> max{0};          ///< max since last reset
+
+	protected:
+
+		/// returns the position of the highest set bit, value must be > 0
+		static int highestBit(std::uint64_t value) {
+			#if defined(__GNUC__) || defined(__clang__)
+				return 63 - __builtin_clzll(value);
+			#else
+				int bit = 0;
+				while(value >>= 1) {bit++;}
+				return bit;
+			#endif
+		}
+};
+
+/// \class LogTimer
+/// \brief RAII scope timer with per-thread latency histograms and periodic
+///        percentile summaries printed via Log
+///
+/// each named series keeps one histogram per recording thread so timing a
+/// scope costs two clock reads and a couple of uncontended stores, nothing
+/// is printed per sample:
+///
+///     void process() {
+///         LOG_TIMER("process");
+///         ...
+///     }
+///
+/// every LOG_TIMER_INTERVAL seconds, the next thread to finish a timer in a
+/// series merges the per-thread histograms and logs the samples since the
+/// last summary as key/value fields, see Log::kv():
+///
+///     timer name=process count=1200 mean_us=40.2 p50_us=38.5 ...
+///
+/// call LogTimer::report() to print all series now, ie. before exiting
+///
+class LogTimer {
+
+	public:
+
+		/// a named series of timings
+		struct Series {
+			std::string name;
+			std::size_t id;                  ///< index into per-thread histograms
+			std::atomic<std::uint64_t> last; ///< last summary time in ns
+			std::mutex mutex;                ///< histograms & previous mutex
+			std::vector<std::shared_ptr<LogHistogram>> histograms;
+			std::vector<std::uint64_t> previous; ///< merged counts at last summary
+			std::uint64_t previousSum = 0;       ///< merged sum at last summary
+			Series(const std::string &name, std::size_t id) :
+				name(name), id(id), last(now()), previous(LogHistogram::BUCKETS, 0) {}
+		};
+
+		/// start timing for a series
+		LogTimer(Series &series) : m_series(series), m_start(now()) {}
+
+		/// record the elapsed time, prints a summary if the interval is up
+		~LogTimer() {
+			std::uint64_t end = now();
+			histogram(m_series).record(end - m_start);
+			std::uint64_t last = m_series.last.load(std::memory_order_relaxed);
+			if(end - last >= interval().load(std::memory_order_relaxed) &&
+			   m_series.last.compare_exchange_strong(last, end)) {
+				summarize(m_series);
+			}
+		}
+
+		/// returns the series for a name, registering it if needed
+		/// note: called once per statement by LOG_TIMER
+		static Series& series(const std::string &name) {
+			Registry &registry = LogTimer::registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			for(std::size_t i = 0; i < registry.series.size(); ++i) {
+				if(registry.series[i]->name == name) {return *registry.series[i];}
+			}
+			registry.series.emplace_back(new Series(name, registry.series.size()));
+			return *registry.series.back();
+		}
+
+		/// set the summary interval in seconds, 0 prints a summary after every
+		/// sample
+		static void setInterval(double seconds) {
+			interval() = (std::uint64_t)(seconds * 1000000000.0);
+		}
+
+		/// returns the summary interval in seconds
+		static double getInterval() {
+			return (double)interval().load() / 1000000000.0;
+		}
+
+		/// print summaries for all series with new samples now
+		static void report() {
+			Registry &registry = LogTimer::registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			for(std::size_t i = 0; i < registry.series.size(); ++i) {
+				registry.series[i]->last = now();
+				summarize(*registry.series[i]);
+			}
+		}
+
+	protected:
+
+		LogTimer(LogTimer const&);              // not defined, not copyable
+		LogTimer& operator = (LogTimer const&); // not defined, not assignable
+
+		/// merge the thread histograms and print the samples since the last
+		/// summary, if any
+		static void summarize(Series &series) {
+			std::vector<std::uint64_t> counts(LogHistogram::BUCKETS, 0);
+			std::uint64_t sum = 0, max = 0;
+			{
+				std::lock_guard<std::mutex> lock(series.mutex);
+				for(std::size_t h = 0; h < series.histograms.size(); ++h) {
+					LogHistogram &histogram = *series.histograms[h];
+					for(int i = 0; i < LogHistogram::BUCKETS; ++i) {
+						counts[i] += histogram.counts[i].load(std::memory_order_relaxed);
+					}
+					sum += histogram.sum.load(std::memory_order_relaxed);
+					std::uint64_t m = histogram.max.exchange(0, std::memory_order_relaxed);
+					if(m > max) {max = m;}
+				}
+				for(int i = 0; i < LogHistogram::BUCKETS; ++i) {
+					std::uint64_t total = counts[i];
+					counts[i] -= series.previous[i];
+					series.previous[i] = total;
+				}
+				std::uint64_t total = sum;
+				sum -= series.previousSum;
+				series.previousSum = total;
+			}
+			std::uint64_t count = 0;
+			for(int i = 0; i < LogHistogram::BUCKETS; ++i) {
+				count += counts[i];
+			}
+			if(count == 0) {return;}
+			LOG << "timer" << Log::kv("name", series.name) << Log::kv("count", count)
+			    << Log::kv("mean_us", (double)sum / (double)count / 1000.0)
+			    << Log::kv("p50_us", percentile(counts, count, max, 0.5))
+			    << Log::kv("p90_us", percentile(counts, count, max, 0.9))
+			    << Log::kv("p99_us", percentile(counts, count, max, 0.99))
+			    << Log::kv("p999_us", percentile(counts, count, max, 0.999))
+			    << Log::kv("max_us", (double)max / 1000.0) << std::endl;
+		}
+
+		/// returns the value in us at a fraction 0 - 1 of the count,
+		/// limited to the max as bucket values are approximate
+		static double percentile(const std::vector<std::uint64_t> &counts,
+		                         std::uint64_t count, std::uint64_t max, double fraction) {
+			std::uint64_t rank = (std::uint64_t)(fraction * (double)count);
+			if(rank >= count) {rank = count - 1;}
+			std::uint64_t seen = 0;
+			for(int i = 0; i < LogHistogram::BUCKETS; ++i) {
+				seen += counts[i];
+				if(seen > rank) {
+					std::uint64_t value = LogHistogram::value(i);
+					return (double)(value < max || max == 0 ? value : max) / 1000.0;
+				}
+			}
+			return 0;
+		}
+
+		/// returns the calling thread's histogram for a series
+		static LogHistogram& histogram(Series &series) {
+			static thread_local std::vector<LogHistogram*> histograms;
+			if(series.id < histograms.size() && histograms[series.id]) {
+				return *histograms[series.id];
+			}
+			if(series.id >= histograms.size()) {
+				histograms.resize(series.id + 1, nullptr);
+			}
+			std::shared_ptr<LogHistogram> histogram = std::make_shared<LogHistogram>();
+			{
+				// owned by the series so samples outlive the thread
+				std::lock_guard<std::mutex> lock(series.mutex);
+				series.histograms.push_back(histogram);
+			}
+			histograms[series.id] = histogram.get();
+			return *histogram;
+		}
+
+		/// steady clock time in ns
+		static std::uint64_t now() {
+			return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/// summary interval in ns
+		static std::atomic<std::uint64_t>& interval() {
+			static std::atomic<std::uint64_t> interval((std::uint64_t)LOG_TIMER_INTERVAL * 1000000000ULL);
+			return interval;
+		}
+
+		/// registered series, kept until exit
+		struct Registry {
+			std::vector<std::unique_ptr<Series>> series;
+			std::mutex mutex;
+		};
+
+		/// shared series registry, function static so no .cpp storage is needed
+		static Registry& registry() {
+			static Registry registry;
+			return registry;
+		}
+
+		Series &m_series;      ///< series to record into
+		std::uint64_t m_start; ///< start time in ns
+};
@@ -0,0 +1,318 @@
+/*==============================================================================
+
+	LogTrace.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include "Log.h"
+
+#if defined( __WIN32__ ) || defined( _WIN32 )
+	#include <process.h>
+	#define LOG_TRACE_PID _getpid()
+#else
+	#include <unistd.h>
+	#define LOG_TRACE_PID getpid()
+#endif
+
+#define LOG_TRACE_CONCAT_(a, b) a##b
+#define LOG_TRACE_CONCAT(a, b) LOG_TRACE_CONCAT_(a, b)
+
+/// trace the enclosing scope as a complete event
+#define LOG_TRACE_SCOPE(name) \
+	LogTrace::Scope LOG_TRACE_CONCAT(log_trace_, __LINE__)(name)
+
+/// begin & end a span, must be nested on the same thread
+#define LOG_TRACE_BEGIN(name) (LogTrace::isRunning() ? LogTrace::add('B', name) : (void)0)
+#define LOG_TRACE_END(name)   (LogTrace::isRunning() ? LogTrace::add('E', name) : (void)0)
+
+/// mark a point in time
+#define LOG_TRACE_INSTANT(name) (LogTrace::isRunning() ? LogTrace::add('i', name) : (void)0)
+
+/// record a counter value, shown as a graph
+#define LOG_TRACE_COUNTER(name, value) \
+	(LogTrace::isRunning() ? LogTrace::add('C', name, 0, (double)(value)) : (void)0)
+
+/// per-thread trace buffer capacity in events, see LogTrace::start()
+#ifndef LOG_TRACE_CAPACITY
+#define LOG_TRACE_CAPACITY 65536
+#endif
+
+/// \class LogTrace
+/// \brief trace span, instant & counter events in Chrome Trace Event format
+///
+/// events are appended to a fixed-size per-thread buffer without locks or
+/// I/O and written as JSON on demand, load the file in chrome://tracing or
+/// https://ui.perfetto.dev to look for stalls:
+///
+///     LogTrace::start();
+///     ...
+///     void process() {
+///         LOG_TRACE_SCOPE("process");
+///         ...
+///         LOG_TRACE_COUNTER("queue", queue.size());
+///     }
+///     ...
+///     LogTrace::stop();
+///     LogTrace::write("trace.json");
+///
+/// macros cost a single relaxed load when not running, events are dropped
+/// and counted once a thread's buffer is full
+///
+/// note: names are not copied and must be string literals or otherwise
+///       outlive the trace
+///
+class LogTrace {
+
+	public:
+
+		/// RAII complete event for a scope
+		class Scope {
+			public:
+				Scope(const char *name) : m_name(name), m_start(0) {
+					if(isRunning()) {m_start = now();}
+				}
+				~Scope() {
+					if(m_start && isRunning()) {add('X', m_name, m_start, 0);}
+				}
+			protected:
+				Scope(Scope const&);              // not defined, not copyable
+				Scope& operator = (Scope const&); // not defined, not assignable
+				const char *m_name;    ///< event name
+				std::uint64_t m_start; ///< start time in ns, 0 if not running
+		};
+
+		/// clear existing events and start tracing with a per-thread capacity,
+		/// each thread clears & resizes it's own buffer when it next adds an
+		/// event, so buffers are never changed under another thread
+		/// note: events being added by other threads while restarting may be lost
+		static void start(std::size_t capacity=LOG_TRACE_CAPACITY) {
+			Registry &registry = LogTrace::registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.capacity.store(capacity, std::memory_order_relaxed);
+			registry.generation.fetch_add(1, std::memory_order_release);
+			registry.start = now();
+			registry.running = true;
+		}
+
+		/// stop tracing, events are kept until the next start
+		static void stop() {registry().running = false;}
+
+		/// is tracing running?
+		static bool isRunning() {
+			return registry().running.load(std::memory_order_relaxed);
+		}
+
+		/// set the calling thread's name shown in the viewer
+		static void setThreadName(const std::string &name) {
+			Buffer &buffer = LogTrace::buffer();
+			std::lock_guard<std::mutex> lock(registry().mutex);
+			buffer.name = name;
+		}
+
+		/// add an event to the calling thread's buffer:
+		/// B begin, E end, i instant, C counter with value, or X complete from
+		/// start time, see the macros
+		static void add(char phase, const char *name, std::uint64_t start=0, double value=0) {
+			Buffer &buffer = LogTrace::buffer();
+			Registry &registry = LogTrace::registry();
+			unsigned int generation = registry.generation.load(std::memory_order_acquire);
+			if(buffer.generation.load(std::memory_order_relaxed) != generation) {
+				reset(buffer, registry, generation); // restarted
+			}
+			std::size_t count = buffer.count.load(std::memory_order_relaxed);
+			if(count >= buffer.events.size()) {
+				buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1,
+				                     std::memory_order_relaxed);
+				return;
+			}
+			Event &event = buffer.events[count];
+			std::uint64_t time = now();
+			event.phase = phase;
+			event.name = name;
+			if(phase == 'X') {
+				event.time = start;
+				event.value = (double)(time - start);
+			}
+			else {
+				event.time = time;
+				event.value = value;
+			}
+			buffer.count.store(count + 1, std::memory_order_release);
+		}
+
+		/// write all events as Chrome Trace Event JSON, best after stop()
+		static void write(std::ostream &out) {
+			Registry &registry = LogTrace::registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			std::string text;
+			std::uint64_t dropped = 0;
+			int pid = (int)LOG_TRACE_PID;
+			bool first = true;
+			unsigned int generation = registry.generation.load(std::memory_order_relaxed);
+			text.append("{\"traceEvents\":[\n");
+			for(std::size_t b = 0; b < registry.buffers.size(); ++b) {
+				Buffer &buffer = *registry.buffers[b];
+				if(buffer.generation.load(std::memory_order_acquire) != generation) {
+					continue; // events from before the last start
+				}
+				std::size_t count = buffer.count.load(std::memory_order_acquire);
+				dropped += buffer.dropped.load(std::memory_order_relaxed);
+				if(!buffer.name.empty()) {
+					begin(text, first, 'M', "thread_name", pid, buffer.tid, 0);
+					text.append(",\"args\":{\"name\":\"");
+					Log::escape(buffer.name.data(), buffer.name.size(), text);
+					text.append("\"}}");
+				}
+				for(std::size_t i = 0; i < count; ++i) {
+					const Event &event = buffer.events[i];
+					std::uint64_t time = (event.time > registry.start ? event.time - registry.start : 0);
+					begin(text, first, event.phase, event.name, pid, buffer.tid, time);
+					char number[64];
+					switch(event.phase) {
+						case 'X':
+							std::snprintf(number, sizeof(number), ",\"dur\":%.3f}", event.value / 1000.0);
+							text.append(number);
+							break;
+						case 'C':
+							text.append(",\"args\":{\"");
+							Log::escape(event.name, std::strlen(event.name), text);
+							std::snprintf(number, sizeof(number), "\":%.17g}}", event.value);
+							text.append(number);
+							break;
+						case 'i':
+							text.append(",\"s\":\"t\"}"); // thread scope
+							break;
+						default:
+							text.append("}");
+					}
+					if(text.size() > 65536) {
+						out.write(text.data(), text.size());
+						text.clear();
+					}
+				}
+			}
+			text.append("\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":\"");
+			text.append(std::to_string(dropped));
+			text.append("\"}}\n");
+			out.write(text.data(), text.size());
+			out.flush();
+		}
+
+		/// write all events to a Chrome Trace Event JSON file,
+		/// returns false if the file could not be written
+		static bool write(const std::string &path) {
+			std::ofstream file(path.c_str(), std::ios::binary);
+			if(!file.is_open()) {
+				LOG_ERROR << "LogTrace: could not open " << path << std::endl;
+				return false;
+			}
+			write(file);
+			return file.good();
+		}
+
+	protected:
+
+		/// a trace event
+		struct Event {
+			const char *name = nullptr;
+			char phase = 'i';       ///< Chrome trace event phase
+			std::uint64_t time = 0; ///< steady clock time in ns
+			double value = 0;       ///< counter value or complete duration in ns
+		};
+
+		/// a thread's events, only the owning thread writes events & counts
+		struct Buffer {
+			std::vector<Event> events;
+			std::atomic<std::size_t> count;      ///< number of events
+			std::atomic<std::uint64_t> dropped;  ///< events dropped when full
+			std::atomic<unsigned int> generation; ///< start() the events are from
+			unsigned int tid;                    ///< trace thread id
+			std::string name;                    ///< thread name, registry mutex
+			Buffer(std::size_t capacity, unsigned int generation, unsigned int tid) :
+				events(capacity), count(0), dropped(0), generation(generation), tid(tid) {}
+		};
+
+		/// registered thread buffers, kept until exit so events outlive threads
+		struct Registry {
+			std::vector<std::shared_ptr<Buffer>> buffers;
+			std::atomic<std::size_t> capacity{LOG_TRACE_CAPACITY};
+			std::atomic<unsigned int> generation{0}; ///< incremented by start()
+			std::atomic<bool> running{false};
+			std::uint64_t start = 0; ///< trace start time in ns
+			std::mutex mutex;
+		};
+
+		/// shared registry, function static so no .cpp storage is needed
+		static Registry& registry() {
+			static Registry registry;
+			return registry;
+		}
+
+		/// returns the calling thread's buffer, registering it if needed
+		static Buffer& buffer() {
+			static thread_local Buffer *buffer = nullptr;
+			if(!buffer) {
+				Registry &registry = LogTrace::registry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				registry.buffers.push_back(std::make_shared<Buffer>(
+					registry.capacity.load(), registry.generation.load(),
+					(unsigned int)registry.buffers.size() + 1));
+				buffer = registry.buffers.back().get();
+			}
+			return *buffer;
+		}
+
+		/// clear the calling thread's buffer for a new generation, write()
+		/// skips it until the generation is set
+		static void reset(Buffer &buffer, Registry &registry, unsigned int generation) {
+			buffer.count.store(0, std::memory_order_relaxed);
+			buffer.dropped.store(0, std::memory_order_relaxed);
+			std::size_t capacity = registry.capacity.load(std::memory_order_relaxed);
+			if(buffer.events.size() != capacity) {buffer.events.resize(capacity);}
+			buffer.generation.store(generation, std::memory_order_release);
+		}
+
+		/// start an event object
+		static void begin(std::string &text, bool &first, char phase, const char *name,
+		                  int pid, unsigned int tid, std::uint64_t time) {
+			char number[96];
+			if(!first) {text.append(",\n");}
+			first = false;
+			text.append("{\"name\":\"");
+			Log::escape(name, std::strlen(name), text);
+			std::snprintf(number, sizeof(number), "\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f",
+			              phase, pid, tid, (double)time / 1000.0);
+			text.append(number);
+		}
+
+		/// steady clock time in ns
+		static std::uint64_t now() {
+			return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+};
@@ -373,8 +373,9 @@ class PathWatcher {
 			
 				std::string path;    ///< relative or absolute path
 				std::string name;    ///< optional contextual name
-				long modified = 0;   ///< last modification st_mtime
-				bool exists = true;  ///< does the path exist?
+				long long modified = 0; ///< last modification time, ns if available
+				long long size = 0;     ///< last size in bytes
+				bool exists = true;     ///< does the path exist?
 			
 				/// create a new Path to watch with optional name
 				Path(const std::string &path, const std::string &name="") {
@@ -394,8 +395,10 @@ class PathWatcher {
 						if(exists) {
 							struct stat attributes;
 							stat(path.c_str(), &attributes);
-							if(modified != attributes.st_mtime) {
-								modified = attributes.st_mtime;
+							long long time = modifiedTime(attributes);
+							if(modified != time || size != (long long)attributes.st_size) {
+								modified = time;
+								size = (long long)attributes.st_size;
 								return MODIFIED;
 							}
 						}
@@ -407,17 +410,34 @@ class PathWatcher {
 					}
 					else if(exists) {
 						modified = 0;
+						size = 0;
 						exists = false;
 						return DELETED;
 					}
 					return NONE;
 				}
 			
-				/// update modification time
+				/// update modification time & size
 				void update() {
 					struct stat attributes;
 					stat(path.c_str(), &attributes);
-					modified = attributes.st_mtime;
+					modified = modifiedTime(attributes);
+					size = (long long)attributes.st_size;
+				}
+
+				/// returns the modification time in ns where the platform
+				/// provides it, otherwise in s, as edits within the same second
+				/// are missed with s alone
+				static long long modifiedTime(const struct stat &attributes) {
+					#if defined( __APPLE__ )
+						return (long long)attributes.st_mtimespec.tv_sec * 1000000000LL +
+						       (long long)attributes.st_mtimespec.tv_nsec;
+					#elif defined( __WIN32__ ) || defined( _WIN32 )
+						return (long long)attributes.st_mtime;
+					#else
+						return (long long)attributes.st_mtim.tv_sec * 1000000000LL +
+						       (long long)attributes.st_mtim.tv_nsec;
+					#endif
 				}
 		};
 
@@ -0,0 +1,159 @@
+/*==============================================================================
+
+	RingBuffer.h
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+	Adapted from Dmitry Vyukov's bounded MPMC queue:
+	http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+==============================================================================*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/// \class RingBuffer
+/// \brief a bounded lock-free multi-producer/multi-consumer ring buffer
+///
+/// each slot carries a sequence number so producers and consumers only
+/// contend on a single atomic index each, no locks or allocation after
+/// construction
+///
+/// values are filled and read in place via functions, so slot storage
+/// (ie. std::string capacity) is reused instead of reallocated:
+///
+///     RingBuffer<std::string> buffer(1024);
+///
+///     // producer thread(s)
+///     buffer.push([](std::string &s) {s.assign("hello");});
+///
+///     // consumer thread(s)
+///     buffer.pop([](std::string &s) {std::cout << s << std::endl;});
+///
+template <class T>
+class RingBuffer {
+
+	public:
+
+		/// create with capacity, rounded up to the next power of 2
+		RingBuffer(std::size_t capacity=1024) {
+			size = 2;
+			while(size < capacity) {
+				size <<= 1;
+			}
+			mask = size - 1;
+			slots = new Slot[size];
+			for(std::size_t i = 0; i < size; ++i) {
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			head.store(0, std::memory_order_relaxed);
+			tail.store(0, std::memory_order_relaxed);
+		}
+		virtual ~RingBuffer() {delete [] slots;}
+
+		/// try to push a value by filling the next free slot in place,
+		/// returns false if the buffer is full
+		template <class F> bool push(F fill) {
+			Slot *slot;
+			std::size_t pos = tail.load(std::memory_order_relaxed);
+			while(true) {
+				slot = &slots[pos & mask];
+				std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+				std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+				if(diff == 0) {
+					if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else if(diff < 0) {
+					return false; // full
+				}
+				else {
+					pos = tail.load(std::memory_order_relaxed);
+				}
+			}
+			fill(slot->value);
+			slot->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// try to pop a value by reading the oldest slot in place,
+		/// returns false if the buffer is empty
+		template <class F> bool pop(F read) {
+			Slot *slot;
+			std::size_t pos = head.load(std::memory_order_relaxed);
+			while(true) {
+				slot = &slots[pos & mask];
+				std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+				std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+				if(diff == 0) {
+					if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else if(diff < 0) {
+					return false; // empty
+				}
+				else {
+					pos = head.load(std::memory_order_relaxed);
+				}
+			}
+			read(slot->value);
+			slot->sequence.store(pos + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// returns true if there are no waiting values,
+		/// only a snapshot when used with multiple threads
+		bool empty() const {
+			return head.load(std::memory_order_acquire) >=
+			       tail.load(std::memory_order_acquire);
+		}
+
+		/// returns the number of waiting values,
+		/// only a snapshot when used with multiple threads
+		std::size_t count() const {
+			std::size_t h = head.load(std::memory_order_acquire);
+			std::size_t t = tail.load(std::memory_order_acquire);
+			return t > h ? t - h : 0;
+		}
+
+		/// returns the slot capacity
+		std::size_t capacity() const {return size;}
+
+	protected:
+
+		RingBuffer(RingBuffer const&);              // not defined, not copyable
+		RingBuffer& operator = (RingBuffer const&); // not defined, not assignable
+
+		/// a value slot with it's turn sequence number
+		struct Slot {
+			std::atomic<std::size_t> sequence;
+			T value;
+		};
+
+		Slot *slots = nullptr; ///< slot storage
+		std::size_t size = 0;  ///< slot count, power of 2
+		std::size_t mask = 0;  ///< size - 1 for fast modulo
+
+		/// padded to keep producers and consumers on separate cache lines
+		char pad0[64];
+		std::atomic<std::size_t> head; ///< next read position
+		char pad1[64];
+		std::atomic<std::size_t> tail; ///< next write position
+		char pad2[64];
+};
@@ -0,0 +1,237 @@
+/*==============================================================================
+
+	logbench.cpp
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+
+// Log microbenchmarks: cost per call across statement types, sync & async
+// mode, thread counts, and sinks
+//
+// build: c++ -std=c++17 -O2 -I.. logbench.cpp -o logbench -lpthread
+// usage: logbench [-t MAXTHREADS] [-n COUNT] [-s SINK] [-c CASE] [-a] [-f PATH]
+//
+// -t runs 1, 2, 4 ... MAXTHREADS threads, default 64
+// -n sets the number of calls per run split across threads, default 1000000
+// -s only runs one sink: null, file, or console, default all
+// -c only runs one case, see the table below
+// -a only runs async mode, default runs sync & async
+// -f sets the file sink path, default logbench.log (removed when done)
+//
+// prints one row per run with the producer side cost: ns/op is wall time
+// per call across all threads, allocs/op counts operator new calls, and
+// p50/p99/p999 are per call latencies in ns sampled every 8th call, which
+// include the cost of the two clock reads, in async mode the backend is
+// drained after timing stops
+//
+// redirect stdout to a file or /dev/null to measure the console sink:
+//
+//     logbench -s console > /dev/null
+//
+// results are printed to stderr as a whitespace separated table, compare
+// runs before & after a change to check it's an improvement
+
+#define LOG_STATIC_LEVEL
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include "Log.h"
+#include "LogSinks.h"
+
+std::atomic<Log::Level> Log::logLevel(Log::LEVEL_NORMAL);
+
+// count allocations per thread so counting doesn't contend
+static thread_local std::uint64_t allocations = 0;
+
+// keep the replacements out of line, otherwise gcc may mistake an inlined
+// free() for a mismatched deallocation
+#if defined(__GNUC__) || defined(__clang__)
+	#define LOGBENCH_NOINLINE __attribute__((noinline))
+#else
+	#define LOGBENCH_NOINLINE
+#endif
+
+LOGBENCH_NOINLINE void* operator new(std::size_t size) {
+	allocations++;
+	void *p = std::malloc(size ? size : 1);
+	if(!p) {throw std::bad_alloc();}
+	return p;
+}
+LOGBENCH_NOINLINE void operator delete(void *p) noexcept {std::free(p);}
+LOGBENCH_NOINLINE void operator delete(void *p, std::size_t) noexcept {std::free(p);}
+
+// a type written via operator<< on the stream
+struct Point {
+	double x, y;
+};
+std::ostream& operator<<(std::ostream &out, const Point &p) {
+	return out << "(" << p.x << ", " << p.y << ")";
+}
+
+// a benchmark case: a single log statement
+struct Case {
+	const char *name;
+	void (*call)(int i);
+};
+
+static const Case cases[] = {
+	{"filtered", [](int i) {LOG_VERBOSE << "filtered " << i << std::endl;}},
+	{"literal",  [](int) {LOG << "a string literal message" << std::endl;}},
+	{"int",      [](int i) {LOG << i << std::endl;}},
+	{"double",   [](int i) {LOG << i * 0.5 << std::endl;}},
+	{"string",   [](int) {
+		static const std::string s("a std::string message");
+		LOG << s << std::endl;
+	}},
+	{"mixed",    [](int i) {
+		LOG << "request " << i << " took " << i * 0.25 << " ms" << std::endl;
+	}},
+	{"stream",   [](int i) {LOG << "point " << Point{(double)i, 1.5} << std::endl;}},
+	{"binary",   [](int i) {
+		LOG_BINARY(Log::LEVEL_NORMAL) << LOG_LITERAL("request ") << i << LOG_LITERAL(" took ")
+		                              << i * 0.25 << LOG_LITERAL(" ms") << std::endl;
+	}},
+	{"warn",     [](int i) {LOG_WARN << "request " << i << " failed" << std::endl;}},
+};
+
+// per-thread results
+struct Result {
+	std::uint64_t allocations = 0;
+	std::vector<std::uint32_t> latencies; // sampled call latencies in ns
+};
+
+static std::uint64_t now() {
+	return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// run count calls of a case split across threads, prints a result row
+static void run(const Case &c, const char *sink, bool async, int threads, int count) {
+	int perThread = count / threads;
+	if(perThread < 1) {perThread = 1;}
+	std::vector<Result> results(threads);
+	for(int t = 0; t < threads; ++t) {
+		results[t].latencies.reserve(perThread / 8 + 1);
+	}
+	if(async) {Log::startAsync();}
+
+	// warm up so thread-local buffers are allocated, with at least one call
+	// per async ring buffer slot so every slot's line storage is allocated
+	const int warmup = std::max(1000, (int)LOG_ASYNC_CAPACITY);
+	for(int i = 0; i < warmup; ++i) {c.call(i);}
+
+	std::atomic<int> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> workers;
+	for(int t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t] {
+			Result &result = results[t];
+			for(int i = 0; i < warmup; ++i) {c.call(i);} // warm up this thread
+			ready++;
+			while(!go) {std::this_thread::yield();}
+			std::uint64_t start = allocations;
+			for(int i = 0; i < perThread; ++i) {
+				if((i & 7) == 0) {
+					std::uint64_t before = now();
+					c.call(i);
+					result.latencies.push_back((std::uint32_t)std::min<std::uint64_t>(now() - before, 0xFFFFFFFF));
+				}
+				else {
+					c.call(i);
+				}
+			}
+			result.allocations = allocations - start;
+		});
+	}
+	while(ready < threads) {std::this_thread::yield();}
+	std::uint64_t start = now();
+	go = true;
+	for(std::thread &worker : workers) {worker.join();}
+	std::uint64_t elapsed = now() - start;
+	if(async) {Log::stopAsync();}
+	Log::flush();
+
+	std::vector<std::uint32_t> latencies;
+	std::uint64_t allocs = 0;
+	for(const Result &result : results) {
+		latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+		allocs += result.allocations;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double fraction) -> unsigned int {
+		if(latencies.empty()) {return 0;}
+		std::size_t index = (std::size_t)(fraction * (double)(latencies.size() - 1));
+		return latencies[index];
+	};
+	double calls = (double)perThread * threads;
+	std::fprintf(stderr, "%-8s %-5s %-8s %7d %10.1f %10.3f %8u %8u %8u\n",
+	             sink, async ? "async" : "sync", c.name, threads,
+	             (double)elapsed / calls, (double)allocs / calls,
+	             percentile(0.5), percentile(0.99), percentile(0.999));
+}
+
+int main(int argc, char *argv[]) {
+	int maxThreads = 64, count = 1000000;
+	const char *onlySink = nullptr, *onlyCase = nullptr;
+	std::string path = "logbench.log";
+	bool onlyAsync = false;
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if(arg == "-a") {onlyAsync = true;}
+		else if(i + 1 < argc && arg == "-t") {maxThreads = std::atoi(argv[++i]);}
+		else if(i + 1 < argc && arg == "-n") {count = std::atoi(argv[++i]);}
+		else if(i + 1 < argc && arg == "-s") {onlySink = argv[++i];}
+		else if(i + 1 < argc && arg == "-c") {onlyCase = argv[++i];}
+		else if(i + 1 < argc && arg == "-f") {path = argv[++i];}
+		else {
+			std::cerr << "Usage: " << argv[0]
+			          << " [-t MAXTHREADS] [-n COUNT] [-s SINK] [-c CASE] [-a] [-f PATH]" << std::endl;
+			return 1;
+		}
+	}
+	if(maxThreads < 1 || count < 1) {
+		std::cerr << "threads & count must be > 0" << std::endl;
+		return 1;
+	}
+
+	const char *sinks[] = {"null", "file", "console"};
+	std::fprintf(stderr, "%-8s %-5s %-8s %7s %10s %10s %8s %8s %8s\n",
+	             "sink", "mode", "case", "threads", "ns/op", "allocs/op", "p50", "p99", "p999");
+	for(const char *sink : sinks) {
+		if(onlySink && std::strcmp(onlySink, sink) != 0) {continue;}
+		if(std::strcmp(sink, "null") == 0) {
+			Log::setSink(std::make_shared<LogNullSink>());
+		}
+		else if(std::strcmp(sink, "file") == 0) {
+			Log::setSink(std::make_shared<LogFileSink>(path, Log::LEVEL_ERROR));
+		}
+		else {
+			Log::setSink(std::make_shared<LogConsoleSink>());
+		}
+		for(int async = (onlyAsync ? 1 : 0); async < 2; ++async) {
+			for(const Case &c : cases) {
+				if(onlyCase && std::strcmp(onlyCase, c.name) != 0) {continue;}
+				for(int threads = 1; threads <= maxThreads; threads *= 2) {
+					run(c, sink, async != 0, threads, count);
+				}
+			}
+		}
+		Log::setSink(nullptr);
+	}
+	std::remove(path.c_str());
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*==============================================================================
+
+	logdecode.cpp
+
+	Copyright (C) 2024 Dan Wilcox <danomatika@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+==============================================================================*/
+
+// decode a binary log written by Log::openBinaryFile() to text
+//
+// build: c++ -std=c++11 -I.. logdecode.cpp -o logdecode -lpthread
+// usage: logdecode [-s] FILE
+//
+// -s prefixes each line with it's statement's file & line
+
+#include <fstream>
+#include "Log.h"
+
+int main(int argc, char *argv[]) {
+	bool showSites = false;
+	const char *path = nullptr;
+	for(int i = 1; i < argc; ++i) {
+		if(std::strcmp(argv[i], "-s") == 0) {
+			showSites = true;
+		}
+		else {
+			path = argv[i];
+		}
+	}
+	if(!path) {
+		std::cerr << "Usage: " << argv[0] << " [-s] FILE" << std::endl;
+		return 1;
+	}
+	std::ifstream in(path, std::ios::binary);
+	if(!in) {
+		std::cerr << "could not open " << path << std::endl;
+		return 1;
+	}
+	if(!Log::decodeBinaryFile(in, std::cout, showSites)) {
+		std::cerr << path << " is not a binary log or is truncated" << std::endl;
+		return 1;
+	}
+	return 0;
+}